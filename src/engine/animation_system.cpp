@@ -0,0 +1,206 @@
+#include "engine/animation_system.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+static const float kNever = std::numeric_limits<float>::max();
+// A next keyframe time every playhead has passed. Wakes a playhead up next update.
+static const float kNow = -std::numeric_limits<float>::max();
+
+AnimationSystem &theAnimationSystem() {
+  // Never deleted, animators can outlive everything else at exit.
+  static AnimationSystem *the_animation_system = new AnimationSystem();
+  return *the_animation_system;
+}
+
+AnimationSystem::AnimationSystem() {}
+
+AnimationSystem::~AnimationSystem() {}
+
+int AnimationSystem::addClip(const vector<int> &frames, const vector<float> &times, bool repeats) {
+  assert(frames.size() == times.size());
+  Clip clip;
+  clip.first = clip_frames_.size();
+  clip.size = frames.size();
+  clip.repeats = repeats;
+  clip_frames_.insert(clip_frames_.end(), frames.begin(), frames.end());
+  clip_times_.insert(clip_times_.end(), times.begin(), times.end());
+  clips_.push_back(clip);
+  return clips_.size() - 1;
+}
+
+int AnimationSystem::addPlayhead() {
+  int playhead;
+  if (free_playheads_.empty()) {
+    playhead = times_.size();
+    times_.push_back(0.0f);
+    last_times_.push_back(0.0f);
+    next_times_.push_back(kNever);
+    forced_lerp_ts_.push_back(0.0f);
+    playing_.push_back(-1);
+    segments_.push_back(0);
+    last_frames_.push_back(0);
+    forced_frames_.push_back(0);
+    flags_.push_back(0);
+    queues_.push_back(deque<int>());
+  } else {
+    playhead = free_playheads_.back();
+    free_playheads_.pop_back();
+  }
+  times_[playhead] = 0.0f;
+  next_times_[playhead] = kNever;
+  playing_[playhead] = -1;
+  last_frames_[playhead] = 0;
+  flags_[playhead] = 0;
+  queues_[playhead].clear();
+  return playhead;
+}
+
+void AnimationSystem::removePlayhead(int playhead) {
+  flags_[playhead] = FREE;
+  next_times_[playhead] = kNever;
+  queues_[playhead].clear();
+  free_playheads_.push_back(playhead);
+}
+
+void AnimationSystem::queue(int playhead, int clip) {
+  if (playing_[playhead] < 0) {
+    // Nothings been animated yet. Start this one right away.
+    start(playhead, clip, 0);
+    return;
+  }
+  // A repeating clip would play forever, so we need to ask it to stop.
+  if (clips_[playing_[playhead]].repeats) flags_[playhead] |= STOP_NEXT_KEYFRAME;
+  queues_[playhead].push_back(clip);
+  if (flags_[playhead] & FINISHED) next_times_[playhead] = kNow;
+}
+
+void AnimationSystem::force(int playhead, int clip) {
+  if (playing_[playhead] < 0) {
+    start(playhead, clip, 0);
+    return;
+  }
+  queues_[playhead].clear();
+  unsigned char flags = flags_[playhead];
+  if (flags & FORCING) {
+    // We can't force because the current clip is already using three keyframes to force.
+    // Tell it to finish soon and play ours after.
+    flags_[playhead] |= STOP_NEXT_KEYFRAME;
+    queues_[playhead].push_back(clip);
+  } else if (flags & FINISHED) {
+    start(playhead, clip, last_frames_[playhead]);
+  } else {
+    // Start from the two keyframes we were between.
+    int second_frame = nextFrame(playhead);
+    float lerp_t = lerpT(playhead);
+    start(playhead, clip, last_frames_[playhead]);
+    flags_[playhead] |= FORCING;
+    forced_frames_[playhead] = second_frame;
+    forced_lerp_ts_[playhead] = lerp_t;
+  }
+}
+
+void AnimationSystem::currentState(int playhead, AnimationState *state) {
+  unsigned char flags = flags_[playhead];
+  if (playing_[playhead] < 0 || flags & FINISHED) {
+    // Nothing needs interpoling here, we just resting on a keyframe.
+    state->frames[0] = state->frames[1] = state->frames[2] = last_frames_[playhead];
+    state->lerp_ts[0] = state->lerp_ts[1] = 0.0f;
+  } else if (flags & FORCING) {
+    // We forced this clip to start in middle of another. So interpolting three different keyframes.
+    state->frames[0] = last_frames_[playhead];
+    state->frames[1] = forced_frames_[playhead];
+    state->frames[2] = nextFrame(playhead);
+    state->lerp_ts[0] = forced_lerp_ts_[playhead];
+    state->lerp_ts[1] = lerpT(playhead);
+  } else {
+    // Interpolating between two keyframes in this clip.
+    state->frames[0] = last_frames_[playhead];
+    state->frames[1] = state->frames[2] = nextFrame(playhead);
+    state->lerp_ts[0] = lerpT(playhead);
+    state->lerp_ts[1] = 0.0f;
+  }
+}
+
+void AnimationSystem::update(float delta_time) {
+  size_t size = times_.size();
+  if (size == 0) return;
+  // Almost every frame every playhead just moves along, which is this loop. Finished and free playheads
+  // move too, it's cheaper than skipping them and harmless as they are never due.
+  float *times = &times_[0];
+  for (size_t i = 0; i < size; ++i) {
+    times[i] += delta_time;
+  }
+  const float *next_times = &next_times_[0];
+  for (size_t i = 0; i < size; ++i) {
+    if (times[i] > next_times[i]) advance(i, delta_time);
+  }
+}
+
+void AnimationSystem::start(int playhead, int clip, int frame) {
+  playing_[playhead] = clip;
+  segments_[playhead] = 0;
+  last_frames_[playhead] = frame;
+  times_[playhead] = 0.0f;
+  last_times_[playhead] = 0.0f;
+  flags_[playhead] &= ~(FINISHED | FORCING | STOP_NEXT_KEYFRAME);
+  if (clips_[clip].size == 0) {
+    finish(playhead);
+  } else {
+    next_times_[playhead] = clip_times_[clips_[clip].first];
+  }
+}
+
+void AnimationSystem::finish(int playhead) {
+  flags_[playhead] |= FINISHED;
+  // If something is waiting, move on to it next update.
+  next_times_[playhead] = queues_[playhead].empty() ? kNever : kNow;
+}
+
+void AnimationSystem::advance(int playhead, float delta_time) {
+  if (flags_[playhead] & FINISHED) {
+    // Move on to the next clip in the queue.
+    int next_clip = queues_[playhead].front();
+    queues_[playhead].pop_front();
+    start(playhead, next_clip, last_frames_[playhead]);
+    times_[playhead] = delta_time;
+    // An empty clip finishes as it starts, and has no keyframes to look at below.
+    if (flags_[playhead] & FINISHED || times_[playhead] <= next_times_[playhead]) return;
+  }
+  const Clip &clip = clips_[playing_[playhead]];
+  const int *frames = &clip_frames_[clip.first];
+  const float *times = &clip_times_[clip.first];
+  float time = times_[playhead];
+  flags_[playhead] &= ~FORCING;
+  if (flags_[playhead] & STOP_NEXT_KEYFRAME) {
+    last_frames_[playhead] = frames[segments_[playhead]];
+    last_times_[playhead] = times[segments_[playhead]];
+    finish(playhead);
+    return;
+  }
+  if (time > times[clip.size - 1]) {
+    // We just finished. Start over if the clip repeats.
+    last_frames_[playhead] = frames[clip.size - 1];
+    if (clip.repeats) {
+      start(playhead, playing_[playhead], last_frames_[playhead]);
+    } else {
+      finish(playhead);
+    }
+    return;
+  }
+  // The next keyframe is the first one we haven't reached yet.
+  int segment = std::lower_bound(times + segments_[playhead], times + clip.size, time) - times;
+  segments_[playhead] = segment;
+  last_frames_[playhead] = frames[segment - 1];
+  last_times_[playhead] = times[segment - 1];
+  next_times_[playhead] = times[segment];
+}
+
+int AnimationSystem::nextFrame(int playhead) {
+  return clip_frames_[clips_[playing_[playhead]].first + segments_[playhead]];
+}
+
+float AnimationSystem::lerpT(int playhead) {
+  return (times_[playhead] - last_times_[playhead]) / (next_times_[playhead] - last_times_[playhead]);
+}
@@ -0,0 +1,72 @@
+#ifndef SRC_ANIMATION_SYSTEM_H_
+#define SRC_ANIMATION_SYSTEM_H_
+
+#include <deque>
+#include <vector>
+
+using std::deque;
+using std::vector;
+
+// Keyframe state for use in rendering. Frames are indices into the shape group's frame table. Always three
+// frames and two lerp values, no matter how many keyframes are actually used.
+struct AnimationState {
+  int frames[3];
+  float lerp_ts[2];
+};
+
+class AnimationSystem;
+
+AnimationSystem &theAnimationSystem();
+
+// Advances every animation in the game at once. Clips are compiled animations, packed end to end in flat
+// arrays. Playheads are where each animator is in its clips, kept as one array per field so a frame's
+// update is a couple of straight passes. Animator is just a handle to a playhead.
+class AnimationSystem {
+  public:
+    AnimationSystem();
+    ~AnimationSystem();
+    // Adds a clip. Times are in seconds since the start of the clip, one per frame. Returns the clip id.
+    int addClip(const vector<int> &frames, const vector<float> &times, bool repeats);
+    // Playheads start out resting on frame zero.
+    int addPlayhead();
+    void removePlayhead(int playhead);
+    // Queue up a clip. This will cause any repeating clip ahead in queue to stop.
+    void queue(int playhead, int clip);
+    // Play a clip right away, clearing the queue. Blends from wherever the current clip was.
+    void force(int playhead, int clip);
+    void currentState(int playhead, AnimationState *state);
+    void update(float delta_time);
+
+  private:
+    struct Clip {
+      int first, size;
+      bool repeats;
+    };
+    enum PlayheadFlags {
+      FINISHED = 1,
+      // Blending from two keyframes of the clip we were forced out of.
+      FORCING = 2,
+      STOP_NEXT_KEYFRAME = 4,
+      FREE = 8
+    };
+    // Helpers.
+    void start(int playhead, int clip, int frame);
+    void finish(int playhead);
+    // Handles a playhead passing its next keyframe. Rare, so kept out of the main update pass.
+    void advance(int playhead, float delta_time);
+    int nextFrame(int playhead);
+    float lerpT(int playhead);
+    // Clips.
+    vector<Clip> clips_;
+    vector<int> clip_frames_;
+    vector<float> clip_times_;
+    // Playheads.
+    vector<float> times_, last_times_, next_times_, forced_lerp_ts_;
+    vector<int> playing_, segments_, last_frames_, forced_frames_;
+    vector<unsigned char> flags_;
+    // Clips waiting behind the one playing. Only looked at when a clip ends.
+    vector<deque<int> > queues_;
+    vector<int> free_playheads_;
+};
+
+#endif  // SRC_ANIMATION_SYSTEM_H_
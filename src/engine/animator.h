@@ -5,85 +5,44 @@
 #include <string>
 #include <vector>
 #include <map>
-#include <queue>
 
-#include "engine/entity.h"
+#include "engine/animation_system.h"
 #include "util/json.h"
 
 using std::string;
 using std::vector;
 using std::map;
-using std::queue;
 
-struct Keyframe {
-  string name;
-  float time;
-};
-
-class Animation {
-  public:
-    Animation();
-    ~Animation();
-    // Add a keyframe with the name of the frame and time to morph.
-    void addKeyframe(Keyframe key);
-    // Repeat animation forever till asked to stop.
-    bool repeats() { return repeat_; }
-    void setRepeats(bool repeat) { repeat_ = repeat; }
-
-    // Functions for during use (used by Animator).
-    // Start animation from the given keyframe.
-    void start(string frame_name);
-    // Start animation in the middle of another animation. So will briefly be interpolating between three keyframes.
-    void startForced(string frame_name1, string frame_name2, float lerp_t);
-    void stopAtNextKeyframe() { stop_next_keyframe_ = true; }
-    void update(float delta_time);
-    // Is currently interpolating with three keyframes.
-    bool forcing() { return forcing_; }
-    bool finished() { return finished_; }
-    // The last keyframe used in animation. If forcing there is no one keyframe, use currentState.
-    string lastKeyframeName() { return last_keyframe_.name; }
-    string nextKeyframeName() { return keyframes_[next_keyframe_].name; }
-    float lerpT() { return lerp_t_; }
-    // Gets the current keyframe state for use in rendering.
-    // Always gives three keyframes and two lerp values, no matter how many keyframes are actually used.
-    void currentState(string frames[], float lerp_ts[]);
-
-  private:
-    vector<Keyframe> keyframes_;
-    bool repeat_, finished_, forcing_, stop_next_keyframe_;
-    Keyframe last_keyframe_;
-    string last_keyframe_second_name_;
-    float last_keyframe_lerp_t_;
-    int next_keyframe_;
-    float time_, lerp_t_;
-};
-
-class Animator : public Entity {
+// Handle to a playhead in the animation system, which does all the updating. Animations are compiled to
+// clips of frame indices when loaded, so nothing is looked up by name after.
+class Animator {
   public:
     Animator();
     ~Animator();
-    // Set up functions.
-    void init(string start_frame) { start_keyframe_name_ = start_frame; }
-    void init(map<string, Animation> animations, string start_frame);
-    void init(const json_value &json_animations, string start_frame);
-
-    void addAnimation(string name, Animation animation) { animations_[name] = animation; }
+    // Set up. Frame names are in the order of the shape group's frame table, the first is where we start.
+    void init(const json_value &json_animations, const vector<string> &frame_names);
 
     // Queue up an animation. This will cause any repeating animations ahead in queue to stop.
-    void queueAnimation(string name);
+    void queueAnimation(string name) { queueAnimation(animationIndex(name)); }
+    void queueAnimation(int animation) { theAnimationSystem().queue(playhead_, clips_[animation]); }
     // Force start an animation. This will delete the queue and move this to front.
     // If the current animation is between keyframes, this will treat that lerped target as the starting keyframe.
     // Forcint the new animation to temporarily lerp between three keyframes.
-    void forceAnimation(string name);
+    void forceAnimation(string name) { forceAnimation(animationIndex(name)); }
+    void forceAnimation(int animation) { theAnimationSystem().force(playhead_, clips_[animation]); }
+    int animationIndex(string name);
     // Gets the current keyframe state for use in rendering.
-    // Always gives three keyframes and two lerp values, no matter how many keyframes are actually used.
-    void currentState(string frames[], float lerp_ts[]);
-    void update(float delta_time);
+    void currentState(AnimationState *state) { theAnimationSystem().currentState(playhead_, state); }
 
   private:
-    map<string, Animation> animations_;
-    queue<Animation *> queued_;
-    string start_keyframe_name_;
+    // A copy would share our playhead.
+    Animator(const Animator &other);
+    Animator& operator=(Animator other);
+    // Member data.
+    int playhead_;
+    // Clip id of each animation.
+    vector<int> clips_;
+    map<string, int> animation_indices_;
 };
 
 #endif  // SRC_ANIMATOR_H_
@@ -2,6 +2,7 @@
 
 #include <glm/gtc/type_ptr.hpp>
 #include <algorithm>
+#include <cstddef>
 
 #include "util/transform2D.h"
 
@@ -50,3 +51,94 @@ void Circle::drawHelper(bool occluder) {
   }
   glDisable(GL_STENCIL_TEST);
 }
+
+CircleBatch::CircleBatch()
+  : changed_(false),
+    extent_changed_(false),
+    min_(0.0f),
+    max_(0.0f),
+    capacity_(0),
+    array_object_(0),
+    quad_buffer_object_(0),
+    instance_buffer_object_(0) {}
+
+CircleBatch::~CircleBatch() {
+  if (array_object_ != 0) {
+    glDeleteVertexArrays(1, &array_object_);
+    glDeleteBuffers(1, &quad_buffer_object_);
+    glDeleteBuffers(1, &instance_buffer_object_);
+  }
+}
+
+void CircleBatch::init() {
+  // Every instance is the same quad, stretched over its circle in the vertex shader.
+  glm::vec2 corners[4] = {glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(1.0f, 1.0f), glm::vec2(0.0f, 1.0f)};
+  glGenVertexArrays(1, &array_object_);
+  glGenBuffers(1, &quad_buffer_object_);
+  glGenBuffers(1, &instance_buffer_object_);
+  glBindVertexArray(array_object_);
+
+  glBindBuffer(GL_ARRAY_BUFFER, quad_buffer_object_);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+  GLuint handle = theEngine().attributeHandle("position");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+
+  // Circle data steps once per instance.
+  glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_object_);
+  handle = theEngine().attributeHandle("instance_center");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, sizeof(CircleInstance), (void *)offsetof(CircleInstance, center));
+  glVertexAttribDivisor(handle, 1);
+  handle = theEngine().attributeHandle("instance_radius");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribPointer(handle, 1, GL_FLOAT, GL_FALSE, sizeof(CircleInstance), (void *)offsetof(CircleInstance, radius));
+  glVertexAttribDivisor(handle, 1);
+  handle = theEngine().attributeHandle("color");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribPointer(handle, 4, GL_FLOAT, GL_FALSE, sizeof(CircleInstance), (void *)offsetof(CircleInstance, color));
+  glVertexAttribDivisor(handle, 1);
+  glBindVertexArray(0);
+}
+
+void CircleBatch::extent(glm::vec2 *min, glm::vec2 *max) {
+  if (extent_changed_) {
+    min_ = glm::vec2(std::numeric_limits<float>::max());
+    max_ = glm::vec2(-std::numeric_limits<float>::max());
+    for (vector<CircleInstance>::iterator it = circles_.begin(); it != circles_.end(); ++it) {
+      min_ = glm::min(it->center - it->radius, min_);
+      max_ = glm::max(it->center + it->radius, max_);
+    }
+    if (circles_.empty()) min_ = max_ = glm::vec2(0.0f);
+    extent_changed_ = false;
+  }
+  *min = min_;
+  *max = max_;
+}
+
+// Orphans the old storage when growing so we never wait on a draw still reading it.
+void CircleBatch::upload() {
+  glBindBuffer(GL_ARRAY_BUFFER, instance_buffer_object_);
+  if (circles_.size() > capacity_) {
+    capacity_ = circles_.size() * 2;
+    glBufferData(GL_ARRAY_BUFFER, capacity_ * sizeof(CircleInstance), NULL, GL_DYNAMIC_DRAW);
+  }
+  glBufferSubData(GL_ARRAY_BUFFER, 0, circles_.size() * sizeof(CircleInstance), &circles_[0]);
+  changed_ = false;
+}
+
+uint64_t CircleBatch::drawKey(bool asOccluder) {
+  return makeDrawKey(0, theEngine().programHandle("circle_batch"), 0, array_object_);
+}
+
+void CircleBatch::drawHelper(bool occluder) {
+  if (circles_.empty()) return;
+  if (changed_) upload();
+  theEngine().useProgram("circle_batch");
+  glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(fullTransform()));
+  glUniform1i(theEngine().uniformHandle("occluder"), occluder);
+  glUniform4fv(theEngine().uniformHandle("occluder_color"), 1,
+    glm::value_ptr(glm::vec4(glm::vec3(occluderColor()), 1.0f)));
+  glBindVertexArray(array_object_);
+  glDrawArraysInstanced(GL_TRIANGLE_FAN, 0, 4, circles_.size());
+}
@@ -33,4 +33,38 @@ class Circle : public Entity {
     GLuint texture_handle_;
 };
 
+// One circle of a CircleBatch.
+struct CircleInstance {
+  glm::vec2 center;
+  float radius;
+  glm::vec4 color;
+};
+
+// Draws any number of solid colored circles with one instanced draw. Each circle is a quad and the
+// fragment shader works out coverage from the distance to the center, so no stencil is needed.
+class CircleBatch : public Entity {
+  public:
+    CircleBatch();
+    ~CircleBatch();
+    void init();
+    // Edit the circles in place, then call markChanged so they are sent before the next draw.
+    vector<CircleInstance> &circles() { return circles_; }
+    void markChanged() { changed_ = true; extent_changed_ = true; }
+    void extent(glm::vec2 *min, glm::vec2 *max);
+    void draw() { drawHelper(false); }
+    void drawOccluder() { drawHelper(true); }
+    uint64_t drawKey(bool asOccluder);
+
+  private:
+    void drawHelper(bool occluder);
+    void upload();
+    // Member data.
+    vector<CircleInstance> circles_;
+    bool changed_, extent_changed_;
+    glm::vec2 min_, max_;
+    // GL stuff
+    size_t capacity_;
+    GLuint array_object_, quad_buffer_object_, instance_buffer_object_;
+};
+
 #endif  // SRC_CIRCLES_H_
@@ -0,0 +1,224 @@
+#include "engine/cpu_particles.h"
+
+#include <algorithm>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+static const int kMaxSpawnPerEmitter = 64;
+
+// The feedback shader's hash and random, so both backends spawn alike.
+static unsigned int hash(unsigned int x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+static float random(unsigned int *state) {
+  *state = hash(*state);
+  return static_cast<float>(*state / 4294967295.0);
+}
+
+static glm::vec3 randomDirection(unsigned int *state) {
+  glm::vec3 direction = glm::vec3(random(state), random(state), random(state)) * 2.0f - 1.0f;
+  return glm::length(direction) > 0.0001f ? glm::normalize(direction) : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+CpuParticles::CpuParticles()
+  : capacity_(0),
+    size_(0),
+    step_(NULL),
+    packed_(NULL) {}
+
+CpuParticles::~CpuParticles() {}
+
+void CpuParticles::init(int capacity) {
+  capacity_ = capacity;
+  size_ = 0;
+  for (int i = 0; i < 3; ++i) {
+    position_[i].resize(capacity);
+    velocity_[i].resize(capacity);
+  }
+  for (int i = 0; i < 4; ++i) color_[i].resize(capacity);
+  age_.resize(capacity);
+  visible_.resize(capacity);
+  emitter_.resize(capacity);
+}
+
+// Live particles move on in parallel, then the dead are dropped and spawns appended after them.
+void CpuParticles::update(const ParticleStep &step) {
+  step_ = &step;
+  pool_.run(integrateTask, this, size_);
+  compact();
+  spawn();
+  step_ = NULL;
+}
+
+void CpuParticles::pack(Particle *out) {
+  packed_ = out;
+  pool_.run(packTask, this, size_);
+  packed_ = NULL;
+}
+
+void CpuParticles::integrateTask(void *particles, int begin, int end) {
+  static_cast<CpuParticles *>(particles)->integrate(begin, end);
+}
+
+void CpuParticles::packTask(void *particles, int begin, int end) {
+  CpuParticles *self = static_cast<CpuParticles *>(particles);
+  for (int i = begin; i < end; ++i) {
+    Particle &particle = self->packed_[i];
+    particle.position = glm::vec3(self->position_[0][i], self->position_[1][i], self->position_[2][i]);
+    particle.velocity = glm::vec3(self->velocity_[0][i], self->velocity_[1][i], self->velocity_[2][i]);
+    particle.color = glm::vec4(self->color_[0][i], self->color_[1][i], self->color_[2][i], self->color_[3][i]);
+    particle.age = self->age_[i];
+    particle.visible = self->visible_[i];
+    particle.emitter = self->emitter_[i];
+  }
+}
+
+// Four particles at a time while there are four left in the range, then one at a time. Collisions
+// branch too much to be worth vectorizing, so they go one at a time after.
+void CpuParticles::integrate(int begin, int end) {
+  const ParticleStep &step = *step_;
+  float delta_time = step.delta_time;
+  float damping = std::max(0.0f, 1.0f - step.drag * delta_time);
+  float fade = delta_time * step.alpha_decay;
+  int i = begin;
+#ifdef __SSE__
+  __m128 delta_times = _mm_set1_ps(delta_time), dampings = _mm_set1_ps(damping), fades = _mm_set1_ps(fade);
+  __m128 gravity_steps[3];
+  for (int axis = 0; axis < 3; ++axis) gravity_steps[axis] = _mm_set1_ps(step.gravity[axis] * delta_time);
+  for (; i + 4 <= end; i += 4) {
+    for (int axis = 0; axis < 3; ++axis) {
+      __m128 velocity = _mm_loadu_ps(&velocity_[axis][i]);
+      velocity = _mm_mul_ps(_mm_add_ps(velocity, gravity_steps[axis]), dampings);
+      _mm_storeu_ps(&velocity_[axis][i], velocity);
+      __m128 position = _mm_loadu_ps(&position_[axis][i]);
+      _mm_storeu_ps(&position_[axis][i], _mm_add_ps(position, _mm_mul_ps(velocity, delta_times)));
+    }
+    _mm_storeu_ps(&age_[i], _mm_add_ps(_mm_loadu_ps(&age_[i]), delta_times));
+    _mm_storeu_ps(&color_[3][i], _mm_sub_ps(_mm_loadu_ps(&color_[3][i]), fades));
+  }
+#endif
+  for (; i < end; ++i) {
+    for (int axis = 0; axis < 3; ++axis) {
+      velocity_[axis][i] = (velocity_[axis][i] + step.gravity[axis] * delta_time) * damping;
+      position_[axis][i] += velocity_[axis][i] * delta_time;
+    }
+    age_[i] += delta_time;
+    color_[3][i] -= fade;
+  }
+  if (step.container_circles->empty() && step.heights == NULL) return;
+  for (i = begin; i < end; ++i) collide(i);
+}
+
+// Circles then ground in the projected 2D space, as the feedback shader does.
+void CpuParticles::collide(int index) {
+  const ParticleStep &step = *step_;
+  glm::vec4 projected = step.projection * glm::vec4(position_[0][index], position_[1][index], position_[2][index], 1.0f);
+  glm::vec3 position2D = glm::vec3(projected) / projected.w;
+  glm::vec2 velocity2D = glm::vec2(velocity_[0][index], velocity_[1][index]);
+
+  const vector<glm::vec3> &circles = *step.container_circles;
+  if (!circles.empty()) {
+    float nearest_distance = 1e20f;
+    glm::vec3 nearest = circles[0];
+    bool inside = false;
+    for (vector<glm::vec3>::const_iterator it = circles.begin(); it != circles.end(); ++it) {
+      float distance = glm::length(glm::vec2(position2D) - glm::vec2(*it)) - (it->z - step.collision_radius);
+      if (distance < 0.0f) {
+        inside = true;
+        break;
+      }
+      if (distance < nearest_distance) {
+        nearest_distance = distance;
+        nearest = *it;
+      }
+    }
+    if (!inside) {
+      glm::vec2 normal = glm::normalize(glm::vec2(position2D) - glm::vec2(nearest));
+      if (glm::dot(normal, velocity2D) >= 0.0f) velocity2D = glm::reflect(velocity2D, normal);
+      glm::vec2 pushed = glm::vec2(nearest) + normal * (nearest.z - step.collision_radius);
+      position2D = glm::vec3(pushed, position2D.z);
+    }
+  }
+
+  if (step.heights != NULL) {
+    glm::vec3 world = step.transform2D * glm::vec3(position2D.x, position2D.y, 1.0f);
+    float u = (world.x - step.heightfield_range.x) / (step.heightfield_range.y - step.heightfield_range.x);
+    if (u >= 0.0f && u <= 1.0f) {
+      float height = heightAt(u);
+      if (world.y < height) {
+        glm::vec3 lifted = step.inverse_transform2D * glm::vec3(world.x, height, 1.0f);
+        position2D = glm::vec3(lifted.x, lifted.y, position2D.z);
+        if (velocity2D.y < 0.0f) velocity2D.y = -velocity2D.y;
+      }
+    }
+  }
+
+  glm::vec4 unprojected = step.inverse_projection * glm::vec4(position2D, 1.0f);
+  for (int axis = 0; axis < 3; ++axis) position_[axis][index] = unprojected[axis] / unprojected.w;
+  velocity_[0][index] = velocity2D.x;
+  velocity_[1][index] = velocity2D.y;
+}
+
+// Linear between heights, the first at u 0 and the last at u 1, like the shader's texture lookup.
+float CpuParticles::heightAt(float u) {
+  const vector<float> &heights = *step_->heights;
+  int last = heights.size() - 1;
+  float texel = glm::clamp(u * last, 0.0f, static_cast<float>(last));
+  int left = static_cast<int>(texel);
+  int right = std::min(left + 1, last);
+  return glm::mix(heights[left], heights[right], texel - left);
+}
+
+// Slides the survivors down over the dead, keeping their order.
+void CpuParticles::compact() {
+  int live = 0;
+  for (int i = 0; i < size_; ++i) {
+    if (age_[i] > step_->lifetime) continue;
+    if (live != i) {
+      for (int axis = 0; axis < 3; ++axis) {
+        position_[axis][live] = position_[axis][i];
+        velocity_[axis][live] = velocity_[axis][i];
+      }
+      for (int channel = 0; channel < 4; ++channel) color_[channel][live] = color_[channel][i];
+      age_[live] = age_[i];
+      visible_[live] = visible_[i];
+      emitter_[live] = emitter_[i];
+    }
+    ++live;
+  }
+  size_ = live;
+}
+
+void CpuParticles::spawn() {
+  const ParticleStep &step = *step_;
+  vector<Emitter> &emitters = *step.emitters;
+  unsigned int seed_hash = hash(step.seed);
+  for (size_t emitter = 0; emitter < emitters.size() && size_ < capacity_; ++emitter) {
+    if (!emitters[emitter].visible()) continue;
+    unsigned int state = hash(emitter ^ seed_hash);
+    int count = std::min(static_cast<int>(emitters[emitter].budgetedRate() * step.delta_time + random(&state)),
+      kMaxSpawnPerEmitter);
+    for (int i = 0; i < count && size_ < capacity_; ++i, ++size_) {
+      glm::vec3 velocity = step.spawn_speed * randomDirection(&state);
+      float age = random(&state) * step.delta_time;
+      glm::vec3 position = emitters[emitter].position() + velocity * age;
+      glm::vec4 color = emitters[emitter].color();
+      color.a -= age * step.alpha_decay;
+      for (int axis = 0; axis < 3; ++axis) {
+        position_[axis][size_] = position[axis];
+        velocity_[axis][size_] = velocity[axis];
+      }
+      for (int channel = 0; channel < 4; ++channel) color_[channel][size_] = color[channel];
+      age_[size_] = age;
+      visible_[size_] = 1.0f;
+      emitter_[size_] = emitter;
+    }
+  }
+}
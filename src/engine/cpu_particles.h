@@ -0,0 +1,62 @@
+#ifndef SRC_CPU_PARTICLES_H_
+#define SRC_CPU_PARTICLES_H_
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "engine/particle_system.h"
+#include "util/thread_pool.h"
+
+using std::vector;
+
+// Everything one simulation step needs besides the particles, the same as the feedback shader's uniforms.
+struct ParticleStep {
+  float delta_time, alpha_decay, lifetime, spawn_speed;
+  unsigned int seed;
+  glm::vec3 gravity;
+  float drag;
+  glm::mat4 projection, inverse_projection;
+  // Empty for no circles, NULL heights for no ground.
+  const vector<glm::vec3> *container_circles;
+  float collision_radius;
+  const vector<float> *heights;
+  glm::vec2 heightfield_range;
+  glm::mat3 transform2D, inverse_transform2D;
+  vector<Emitter> *emitters;
+};
+
+// Particles simulated on the CPU, for GLs where transform feedback is slow or missing. Stored as a
+// structure of arrays, so SSE moves four particles at a time, and split over a thread pool. Steps the
+// same way as the feedback shader, random spawns included.
+class CpuParticles {
+  public:
+    CpuParticles();
+    ~CpuParticles();
+    void init(int capacity);
+    // Live particles, packed at the front.
+    int size() { return size_; }
+    void update(const ParticleStep &step);
+    // Writes the live particles interleaved, laid out the way the particle buffers hold them.
+    void pack(Particle *out);
+
+  private:
+    // Thread pool tasks.
+    static void integrateTask(void *particles, int begin, int end);
+    static void packTask(void *particles, int begin, int end);
+    // Helpers.
+    void integrate(int begin, int end);
+    void collide(int index);
+    float heightAt(float u);
+    void compact();
+    void spawn();
+    // Member data.
+    vector<float> position_[3], velocity_[3], color_[4], age_, visible_;
+    vector<int> emitter_;
+    int capacity_, size_;
+    // Only set while updating or packing, for the tasks.
+    const ParticleStep *step_;
+    Particle *packed_;
+    ThreadPool pool_;
+};
+
+#endif  // SRC_CPU_PARTICLES_H_
@@ -4,9 +4,14 @@
 #include <gli/gli.hpp>
 #include <gli/gtx/gl_texture2d.hpp>
 
+#include "engine/animation_system.h"
+#include "engine/particle_budget.h"
 #include "util/error.h"
 #include "util/transform2D.h"
 
+static const string kShaderDirectory = "src/engine/shaders/";
+static const GLuint kUnknownTexture = static_cast<GLuint>(-1);
+
 static Engine the_engine;
 
 Engine &theEngine() {
@@ -16,7 +21,9 @@ Engine &theEngine() {
 Engine::Engine()
   : left_of_window_(0.0f),
     light_position_(0.0f),
-    current_program_(NULL) {}
+    current_program_(NULL) {
+  forgetTextures();
+}
 
 Engine::~Engine() {}
 
@@ -32,7 +39,7 @@ void Engine::init(int width, int height) {
 
   loadShaders();
   setupUnitQuad();
-  setupFBOs();
+  setupRenderGraph();
 
   useProgram("shadows");
   glUniform1f(uniformHandle("density"), 2.0f);
@@ -72,42 +79,21 @@ void Engine::setupUnitQuad() {
   glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, 0, NULL);
 }
 
-void Engine::setupFBOs() {
-  glGenFramebuffers(1, &occluder_frame_buffer_);
-  glBindFramebuffer(GL_FRAMEBUFFER, occluder_frame_buffer_);
-
-  glGenTextures(1, &occluder_texture_);
-  glBindTexture(GL_TEXTURE_2D, occluder_texture_);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width_/2, height_/2, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, occluder_texture_, 0);
-  
-  glGenRenderbuffers(1, &occluder_stencil_);
-  glBindRenderbuffer(GL_RENDERBUFFER, occluder_stencil_);
-  // I think we need the depth packaged along with stencil. Stencil only formats aren't supported on any hardware.
-  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width_/2, height_/2);
-  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, occluder_stencil_);
-
-  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-  if (status != GL_FRAMEBUFFER_COMPLETE) {
-    error("Occlusion framebuffer object not complete. Something went wrong :(\n");
-  }
-
-  glGenFramebuffers(1, &shadow_frame_buffer_);
-  glBindFramebuffer(GL_FRAMEBUFFER, shadow_frame_buffer_);
-
-  glGenTextures(1, &shadow_texture_);
-  glBindTexture(GL_TEXTURE_2D, shadow_texture_);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width_/2, height_/2, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, shadow_texture_, 0);
-  
-  status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-  if (status != GL_FRAMEBUFFER_COMPLETE) {
-    error("Exposure framebuffer object not complete. Something went wrong :(\n");
-  }
+// Occluders are drawn at half size, then blurred towards the light into an exposure texture that shadowed
+// fills darken with.
+void Engine::setupRenderGraph() {
+  RenderTargetDesc occluders = {0.5f, GL_RED, GL_NEAREST, true};
+  RenderTargetDesc shadows = {0.5f, GL_RED, GL_LINEAR, false};
+  occluder_target_ = render_graph_.addTarget("occluders", occluders);
+  shadow_target_ = render_graph_.addTarget("shadows", shadows);
+
+  render_graph_.addPass("occluders", new MethodPass<Engine>(this, &Engine::drawOccluders), occluder_target_);
+  int shadow_pass = render_graph_.addPass("shadows", new MethodPass<Engine>(this, &Engine::drawShadows), shadow_target_);
+  render_graph_.read(shadow_pass, occluder_target_);
+  int scene_pass = render_graph_.addPass("scene", new MethodPass<Engine>(this, &Engine::drawScene),
+    RenderGraph::kBackbuffer);
+  render_graph_.read(scene_pass, shadow_target_);
+  render_graph_.compile(width_, height_);
 }
 
 void Engine::loadShaders() {
@@ -115,7 +101,6 @@ void Engine::loadShaders() {
   attribute_handles_["position"] = 0;
   attribute_handles_["lerp_position1"] = 1;
   attribute_handles_["lerp_position2"] = 2;
-  attribute_handles_["color"] = 3;
   attribute_handles_["tex_coord"] = 4;
   attribute_handles_["bezier_coord"] = 5;
   // Particle attributes. These are only used with particle programs so we could give them there own set of numbers.
@@ -123,197 +108,177 @@ void Engine::loadShaders() {
   attribute_handles_["color"] = 7;
   attribute_handles_["age"] = 8;
   attribute_handles_["visible"] = 9;
-
-  Shader general_vert, animated_vert, textured_frag, textured_with_shadows_frag, minimal_frag,
-    quadric_frag, cubic_geom, cubic_frag, circles_frag, shadows_vert, shadows_frag,
-    text_stencil_frag, text_to_texture_frag, particle_feedback_vert, particle_draw_vert,
-    particle_draw_geom, particle_draw_frag;
-  general_vert.load("src/engine/shaders/general.vert", GL_VERTEX_SHADER);
-  animated_vert.load("src/engine/shaders/animated.vert", GL_VERTEX_SHADER);
-  textured_frag.load("src/engine/shaders/textured.frag", GL_FRAGMENT_SHADER);
-  textured_with_shadows_frag.load("src/engine/shaders/textured_with_shadows.frag", GL_FRAGMENT_SHADER);
-  minimal_frag.load("src/engine/shaders/minimal.frag", GL_FRAGMENT_SHADER);
-  quadric_frag.load("src/engine/shaders/quadric_anti_aliased.frag", GL_FRAGMENT_SHADER);
-  cubic_geom.load("src/engine/shaders/cubic.geom", GL_GEOMETRY_SHADER);
-  cubic_frag.load("src/engine/shaders/cubic_anti_aliased.frag", GL_FRAGMENT_SHADER);
-  circles_frag.load("src/engine/shaders/circles_anti_aliased.frag", GL_FRAGMENT_SHADER);
-  shadows_frag.load("src/engine/shaders/shadows.frag", GL_FRAGMENT_SHADER);
-  text_stencil_frag.load("src/engine/shaders/text_stencil.frag", GL_FRAGMENT_SHADER);
-  text_to_texture_frag.load("src/engine/shaders/text_to_texture.frag", GL_FRAGMENT_SHADER);
-  particle_feedback_vert.load("src/engine/shaders/particle_feedback.vert", GL_VERTEX_SHADER);
-  particle_draw_vert.load("src/engine/shaders/particle_draw.vert", GL_VERTEX_SHADER);
-  particle_draw_geom.load("src/engine/shaders/particle_draw.geom", GL_GEOMETRY_SHADER);
-  particle_draw_frag.load("src/engine/shaders/particle_draw.frag", GL_FRAGMENT_SHADER);
-  
-  programs_["textured"].init();
-  programs_["textured"].addShader(&general_vert);
-  programs_["textured"].addShader(&textured_frag);
-
-  programs_["textured_with_shadows"].init();
-  programs_["textured_with_shadows"].addShader(&general_vert);
-  programs_["textured_with_shadows"].addShader(&textured_with_shadows_frag);
-
-  programs_["minimal"].init();
-  programs_["minimal"].addShader(&general_vert);
-  programs_["minimal"].addShader(&minimal_frag);
-  
-  programs_["minimal_animated"].init();
-  programs_["minimal_animated"].addShader(&animated_vert);
-  programs_["minimal_animated"].addShader(&minimal_frag);
-
-  programs_["quadric"].init();
-  programs_["quadric"].addShader(&general_vert);
-  programs_["quadric"].addShader(&quadric_frag);
-  
-  programs_["quadric_animated"].init();
-  programs_["quadric_animated"].addShader(&animated_vert);
-  programs_["quadric_animated"].addShader(&quadric_frag);
-
-  programs_["cubic"].init();
-  programs_["cubic"].addShader(&general_vert);
-  programs_["cubic"].addShader(&cubic_geom);
-  programs_["cubic"].addShader(&cubic_frag);
-
-  programs_["cubic_animated"].init();
-  programs_["cubic_animated"].addShader(&animated_vert);
-  programs_["cubic_animated"].addShader(&cubic_geom);
-  programs_["cubic_animated"].addShader(&cubic_frag);
-
-  programs_["circles"].init();
-  programs_["circles"].addShader(&general_vert);
-  programs_["circles"].addShader(&circles_frag);
-  
-  programs_["shadows"].init();
-  programs_["shadows"].addShader(&general_vert);
-  programs_["shadows"].addShader(&shadows_frag);
-
-  programs_["text_stencil"].init();
-  programs_["text_stencil"].addShader(&general_vert);
-  programs_["text_stencil"].addShader(&text_stencil_frag);
-  
-  programs_["text_to_texture"].init();
-  programs_["text_to_texture"].addShader(&general_vert);
-  programs_["text_to_texture"].addShader(&text_to_texture_frag);
-
-  programs_["particle_feedback"].init();
-  programs_["particle_feedback"].addShader(&particle_feedback_vert);
-  const GLchar* varyings[5];
-  varyings[0] = "feedback_position";
-  varyings[1] = "feedback_velocity";
-  varyings[2] = "feedback_color";
-  varyings[3] = "feedback_age";
-  varyings[4] = "feedback_visible";
-  glTransformFeedbackVaryings(programs_["particle_feedback"].handle(), 5, varyings, GL_INTERLEAVED_ATTRIBS);
-
-  programs_["particle_draw"].init();
-  programs_["particle_draw"].addShader(&particle_draw_vert);
-  programs_["particle_draw"].addShader(&particle_draw_geom);
-  programs_["particle_draw"].addShader(&particle_draw_frag);
-
-  setAttributesAndLink();
-  setTextureUnits();
+  // Index of the emitter a particle belongs to, an integer attribute.
+  attribute_handles_["emitter"] = 3;
+  // Bezier coords for the other two keyframes of an animated path.
+  attribute_handles_["lerp_bezier_coord1"] = 10;
+  attribute_handles_["lerp_bezier_coord2"] = 11;
+  // Which implicit curve a path triangle belongs to.
+  attribute_handles_["segment_type"] = 12;
+  // Per instance circle data for circle batches.
+  attribute_handles_["instance_center"] = 13;
+  attribute_handles_["instance_radius"] = 14;
+  // Color addition of batched quads, the multiplier goes in color.
+  attribute_handles_["color_add"] = 15;
+
+  // Only the recipes here. Variants are compiled when first used.
+  ProgramRecipe *recipe = &addRecipe("textured", "general.vert", "textured.frag");
+  recipe->shaders.push_back(std::make_pair(kShaderDirectory + "coverage.frag", GL_FRAGMENT_SHADER));
+  recipe->texture_units["color_texture"] = 0;
+  recipe->texture_units["shadow_texture"] = 1;
+
+  recipe = &addRecipe("quad_batch", "quad_batch.vert", "textured.frag");
+  recipe->shaders.push_back(std::make_pair(kShaderDirectory + "coverage.frag", GL_FRAGMENT_SHADER));
+  recipe->flags = BATCHED;
+  recipe->texture_units["color_texture"] = 0;
+  recipe->texture_units["shadow_texture"] = 1;
+
+  recipe = &addRecipe("minimal", "general.vert", "minimal.frag");
+  recipe->shaders.push_back(std::make_pair(kShaderDirectory + "coverage.frag", GL_FRAGMENT_SHADER));
+
+  recipe = &addRecipe("path", "general.vert", "path.frag");
+  recipe->shaders.push_back(std::make_pair(kShaderDirectory + "coverage.frag", GL_FRAGMENT_SHADER));
+  recipe->flags = PATH;
+
+  // Cubics of animated paths whose keyframes can't share a split, see CubicPlan.
+  recipe = &addRecipe("path_cubic", "general.vert", "path.frag");
+  recipe->shaders.push_back(std::make_pair(kShaderDirectory + "path_cubic.geom", GL_GEOMETRY_SHADER));
+  recipe->shaders.push_back(std::make_pair(kShaderDirectory + "coverage.frag", GL_FRAGMENT_SHADER));
+  recipe->flags = PATH;
+
+  addRecipe("circles", "general.vert", "circles_anti_aliased.frag");
+  addRecipe("circle_batch", "circle_batch.vert", "circle_batch.frag");
+
+  recipe = &addRecipe("shadows", "general.vert", "shadows.frag");
+  recipe->texture_units["occluder_texture"] = 0;
+
+  addRecipe("text_stencil", "general.vert", "text_stencil.frag");
+  addRecipe("text_distance_stencil", "general.vert", "text_distance_stencil.frag");
+
+  recipe = &addRecipe("particle_feedback", "particle_feedback.vert", "");
+  recipe->shaders.push_back(std::make_pair(kShaderDirectory + "particle_feedback.geom", GL_GEOMETRY_SHADER));
+  recipe->feedback_varyings.push_back("feedback_position");
+  recipe->feedback_varyings.push_back("feedback_velocity");
+  recipe->feedback_varyings.push_back("feedback_color");
+  recipe->feedback_varyings.push_back("feedback_age");
+  recipe->feedback_varyings.push_back("feedback_visible");
+  recipe->feedback_varyings.push_back("feedback_emitter");
+  recipe->texture_units["emitters"] = 1;
+  recipe->texture_units["heightfield"] = 2;
+
+  recipe = &addRecipe("particle_draw", "particle_draw.vert", "particle_draw.frag");
+  recipe->shaders.push_back(std::make_pair(kShaderDirectory + "particle_draw.geom", GL_GEOMETRY_SHADER));
+  recipe->texture_units["color_texture"] = 0;
+  recipe->texture_units["emitters"] = 1;
+
+  recipe = &addRecipe("particle_billboard", "particle_billboard.vert", "particle_draw.frag");
+  recipe->texture_units["color_texture"] = 0;
+  recipe->texture_units["emitters"] = 1;
+
+  recipe = &addRecipe("particle_composite", "general.vert", "particle_composite.frag");
+  recipe->texture_units["accumulation_texture"] = 0;
+  recipe->texture_units["weight_texture"] = 1;
 }
 
-void Engine::setAttributesAndLink() {
-  for (map<string, Program>::iterator program_it = programs_.begin(); program_it != programs_.end(); ++program_it) {
-    // Keep our vertex attributes in a consistent location accross programs.
-    // This way we can VAOs with different programs without worrying.
-    for (map<string, GLuint>::iterator attr_it = attribute_handles_.begin(); attr_it != attribute_handles_.end(); ++attr_it) {
-      program_it->second.setAttributeHandle(attr_it->first, attr_it->second);
-    }
-    program_it->second.link();
+ProgramRecipe &Engine::addRecipe(string program, string vertex_file, string fragment_file) {
+  ProgramRecipe &recipe = recipes_[program];
+  recipe.flags = 0;
+  recipe.shaders.push_back(std::make_pair(kShaderDirectory + vertex_file, GL_VERTEX_SHADER));
+  if (!fragment_file.empty()) {
+    recipe.shaders.push_back(std::make_pair(kShaderDirectory + fragment_file, GL_FRAGMENT_SHADER));
   }
+  return recipe;
 }
 
-void Engine::setTextureUnits() {
-  useProgram("textured");
-  glUniform1i(uniformHandle("color_texture"), 0);
+// Shaders are shared between the programs using the same file with the same flags.
+Shader *Engine::loadShader(string filename, GLenum type, unsigned int flags) {
+  pair<string, unsigned int> key(filename, flags);
+  if (shaders_.count(key) == 0) shaders_[key].load(filename, type, flags);
+  return &shaders_[key];
+}
 
-  useProgram("textured_with_shadows");
-  glUniform1i(uniformHandle("color_texture"), 0);
-  glUniform1i(uniformHandle("shadow_texture"), 1);
+Program *Engine::loadProgram(string name, unsigned int flags) {
+  if (recipes_.count(name) == 0) error("No such program %s. Set it up in engine.\n", name.c_str());
+  ProgramRecipe &recipe = recipes_[name];
+  flags |= recipe.flags;
+  pair<string, unsigned int> key(name, flags);
+  if (programs_.count(key) != 0) return &programs_[key];
+
+  Program &program = programs_[key];
+  program.init();
+  for (vector<pair<string, GLenum> >::iterator it = recipe.shaders.begin(); it != recipe.shaders.end(); ++it) {
+    program.addShader(loadShader(it->first, it->second, flags));
+  }
+  // Keep our vertex attributes in a consistent location accross programs.
+  // This way we can VAOs with different programs without worrying.
+  for (map<string, GLuint>::iterator attr_it = attribute_handles_.begin(); attr_it != attribute_handles_.end(); ++attr_it) {
+    program.setAttributeHandle(attr_it->first, attr_it->second);
+  }
+  if (!recipe.feedback_varyings.empty()) {
+    vector<const GLchar *> varyings;
+    for (size_t i = 0; i < recipe.feedback_varyings.size(); ++i) {
+      varyings.push_back(recipe.feedback_varyings[i].c_str());
+    }
+    glTransformFeedbackVaryings(program.handle(), varyings.size(), &varyings[0], GL_INTERLEAVED_ATTRIBS);
+  }
+  program.link();
 
-  useProgram("shadows");
-  glUniform1i(uniformHandle("occluder_texture"), 0);
+  program.use();
+  for (map<string, int>::iterator it = recipe.texture_units.begin(); it != recipe.texture_units.end(); ++it) {
+    GLint handle = glGetUniformLocation(program.handle(), it->first.c_str());
+    if (handle != -1) glUniform1i(handle, it->second);
+  }
+  // Put back whatever was in use, so useProgram's check stays right.
+  if (current_program_ != NULL) current_program_->use();
+  return &program;
+}
 
-  useProgram("particle_draw");
-  glUniform1i(uniformHandle("color_texture"), 0);
+void Engine::update(float delta_time) {
+  // Animations first, they're all advanced in one go.
+  theAnimationSystem().update(delta_time);
+  // Before anything updates particles, so they spawn within this frame's budget.
+  theParticleBudget().update(delta_time);
+  root_entity_.updateAll(delta_time);
 }
 
 void Engine::draw() {
   glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
   // 2D rendering modelview
-  glm::mat3 view(1.0f);
-  view = translate2D(view, glm::vec2(-1.0f, -1.0f));
-  view = scale2D(view, glm::vec2(2.0f/aspect_, 2.0f));
-  root_entity_.setRelativeTransform(view);
-
-  // Draw occluders to texture.
-  //glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  //glViewport(0,0,width_, height_);
-  glBindFramebuffer(GL_FRAMEBUFFER, occluder_frame_buffer_);
-  glViewport(0,0,width_/2, height_/2);
+  view_ = glm::mat3(1.0f);
+  view_ = translate2D(view_, glm::vec2(-1.0f, -1.0f));
+  view_ = scale2D(view_, glm::vec2(2.0f/aspect_, 2.0f));
+  root_entity_.setRelativeTransform(view_);
+  render_graph_.execute();
+}
+
+void Engine::drawOccluders(RenderGraph *) {
   glDepthMask(GL_TRUE);
   glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   glDepthMask(GL_FALSE);
   root_entity_.drawAllOccluders();
-  //return;
-  
-  //glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  //glViewport(0,0,width_, height_);
-  glBindFramebuffer(GL_FRAMEBUFFER, shadow_frame_buffer_);
-  glDepthMask(GL_TRUE);
-  glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  glDepthMask(GL_FALSE);
+}
+
+void Engine::drawShadows(RenderGraph *graph) {
+  glClear(GL_COLOR_BUFFER_BIT);
   useProgram("shadows");
-  glm::vec3 transformed_light_position = view * glm::vec3(light_position_, 1.0f);
+  glm::vec3 transformed_light_position = view_ * glm::vec3(light_position_, 1.0f);
   glUniform2fv(uniformHandle("light_position"), 1, glm::value_ptr(transformed_light_position));
-  glBindTexture(GL_TEXTURE_2D, shadow_texture_);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, occluder_texture_);
+  bindTexture(0, graph->texture(occluder_target_));
   glm::mat3 screen_transform = glm::mat3(1.0f);
   screen_transform = translate2D(screen_transform, glm::vec2(-1.0));
   screen_transform = scale2D(screen_transform, glm::vec2(2.0));
   glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(screen_transform));
   drawUnitQuad();
-  //return;
+}
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
-  glViewport(0,0,width_, height_);
+void Engine::drawScene(RenderGraph *graph) {
   glDepthMask(GL_TRUE);
   glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   glDepthMask(GL_FALSE);
   glEnable(GL_MULTISAMPLE);
   glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE);
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, shadow_texture_);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  bindTexture(1, graph->texture(shadow_target_));
   root_entity_.drawAll();
-
-  //if (do_stencil_) {
-  //  glEnable(GL_STENCIL_TEST);
-  //  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-  //  glStencilFunc(GL_ALWAYS, 0, 0xFF);
-  //  glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
-  //  for (vector<Entity *>::iterator it = draw2D.begin(); it != draw2D.end(); ++it) {
-  //    if ((*it)->is3DStencil()) (*it)->draw();
-  //  }
-  //  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-  //  glStencilFunc(GL_NOTEQUAL, 0, 0xFF);
-  //  glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-  //}
-  //glDisable(GL_SAMPLE_ALPHA_TO_COVERAGE);
-  //glEnable(GL_BLEND);
-  //for (vector<Drawable *>::iterator it = draw3D_.begin(); it != draw3D_.end(); ++it) {
-  //  (*it)->draw();
-  //}
-  //glDisable(GL_BLEND);
-  //if (do_stencil_) {
-  //  glDisable(GL_STENCIL_TEST);
-  //}
 }
 
 void Engine::drawUnitQuad() {
@@ -321,12 +286,38 @@ void Engine::drawUnitQuad() {
   glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
 }
 
-void Engine::useProgram(string program) {
-  if (programs_.count(program) == 0) error("No such program %s. Set it up in engine.\n", program.c_str());
-  current_program_ = &programs_[program];
+void Engine::useProgram(string program, unsigned int flags) {
+  Program *next_program = loadProgram(program, flags);
+  // Sorted draws often ask for the program they already have.
+  if (next_program == current_program_) return;
+  current_program_ = next_program;
   current_program_->use();
 }
 
+GLuint Engine::programHandle(string program, unsigned int flags) {
+  return loadProgram(program, flags)->handle();
+}
+
+// Leaves the unit active as well, so texture calls after this go to the texture asked for.
+void Engine::bindTexture(int unit, GLuint texture, GLenum target) {
+  if (active_texture_unit_ != unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    active_texture_unit_ = unit;
+  }
+  if (target != GL_TEXTURE_2D) {
+    glBindTexture(target, texture);
+    return;
+  }
+  if (bound_textures_[unit] == texture) return;
+  glBindTexture(GL_TEXTURE_2D, texture);
+  bound_textures_[unit] = texture;
+}
+
+void Engine::forgetTextures() {
+  active_texture_unit_ = -1;
+  for (int i = 0; i < kTextureUnits; ++i) bound_textures_[i] = kUnknownTexture;
+}
+
 GLuint Engine::uniformHandle(string uniform) {
   return current_program_->uniformHandle(uniform);
 }
@@ -338,6 +329,8 @@ GLuint Engine::attributeHandle(string attribute) {
 GLuint Engine::getTexture(string filename) {
   if (textures_.count(filename) == 0) {
     textures_[filename] = gli::createTexture2D(filename);
+    // Gli binds the new texture behind our back.
+    forgetTextures();
   }
   return textures_[filename];
 }
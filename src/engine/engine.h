@@ -7,16 +7,35 @@
 #include <vector>
 #include <list>
 #include <map>
+#include <utility>
 
 #include "engine/entity.h"
+#include "engine/render_graph.h"
 #include "engine/shader_program.h"
 
 using std::string;
 using std::vector;
 using std::map;
+using std::pair;
 
 class Engine;
 
+// Texture units the engine keeps track of.
+static const int kTextureUnits = 4;
+
+// How to build a program. Variants of it are compiled and linked the first time they are used, with the
+// requested shader flags defined.
+struct ProgramRecipe {
+  // Filenames and shader types.
+  vector<pair<string, GLenum> > shaders;
+  // Flags every variant has.
+  unsigned int flags;
+  // Captured in order, interleaved.
+  vector<string> feedback_varyings;
+  // Sampler uniforms and their texture units. Samplers a variant compiles out are skipped.
+  map<string, int> texture_units;
+};
+
 Engine &theEngine();
 
 // Does all the setting up of OpenGL and draws all the shapes in the scene.
@@ -32,18 +51,31 @@ class Engine {
     // draw everything
     void draw();
     // update everything
-    void update(float delta_time) { root_entity_.updateAll(delta_time); }
+    void update(float delta_time);
 
     // Gets the length in x axis of the area the camera will render.
     float windowWidth() { return aspect_; }
     // Sets location of our light source for the god rays.
     void setLightPosition(glm::vec2 position) { light_position_ = position; }
     float getPixelHeight(float height) { return height_ * height; }
+    // Converts a size in screen coordinates, where the window spans -1 to 1, to a size in pixels.
+    glm::vec2 screenToPixels(glm::vec2 size) { return size * glm::vec2(width_, height_) / 2.0f; }
 
     // =====GL stuff=====
     // Draws a quad with vertices and tex coords from (0, 0) to (1, 1)
     void drawUnitQuad();
-    void useProgram(string program);
+    // Flags pick a variant of the program, see ShaderFlag.
+    void useProgram(string program, unsigned int flags = 0);
+    // GL handle of a program variant, compiling it if needed. For sorting draws by program.
+    GLuint programHandle(string program, unsigned int flags = 0);
+    // Binds a 2D texture to a texture unit, skipping GL when it's already there. Every 2D texture bind should
+    // come through here so we know what is bound. Other targets are bound every time, but still go through
+    // here to keep the active unit straight.
+    void bindTexture(int unit, GLuint texture, GLenum target = GL_TEXTURE_2D);
+    // Call after deleting textures, so we don't think one is still bound.
+    void forgetTextures();
+    // Prints GPU time of each render pass since the last print.
+    void printPassTimes() { render_graph_.printTimes(); }
     // Get handle for uniform shader variable for currently in use program.
     GLuint uniformHandle(string uniform);
     // Get handle for varying attribute these do not change across programs.
@@ -54,22 +86,34 @@ class Engine {
   private:
     // Helper methods.
     void setupUnitQuad();
-    void setupFBOs();
+    void setupRenderGraph();
     void loadShaders();
-    void setAttributesAndLink();
-    void setTextureUnits();
+    ProgramRecipe &addRecipe(string program, string vertex_file, string fragment_file);
+    Program *loadProgram(string program, unsigned int flags);
+    Shader *loadShader(string filename, GLenum type, unsigned int flags);
+    // Render passes.
+    void drawOccluders(RenderGraph *graph);
+    void drawShadows(RenderGraph *graph);
+    void drawScene(RenderGraph *graph);
     // Memeber data.
     int width_, height_;
     float aspect_, left_of_window_;
     glm::vec2 light_position_;
     Entity root_entity_;
     Program *current_program_;
-    map<string, Program> programs_;
+    map<string, ProgramRecipe> recipes_;
+    // Compiled variants, by name and flags.
+    map<pair<string, unsigned int>, Program> programs_;
+    map<pair<string, unsigned int>, Shader> shaders_;
     map<string, GLuint> attribute_handles_;
     map<string, GLuint> textures_;
+    // What we last bound, negative or all ones when we don't know.
+    int active_texture_unit_;
+    GLuint bound_textures_[kTextureUnits];
     // GL.
-    GLuint occluder_frame_buffer_, occluder_texture_, occluder_stencil_;
-    GLuint shadow_frame_buffer_, shadow_texture_;
+    RenderGraph render_graph_;
+    int occluder_target_, shadow_target_;
+    glm::mat3 view_;
     GLuint quad_array_object_;
 };
 
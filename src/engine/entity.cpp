@@ -2,6 +2,8 @@
 
 #include <algorithm>
 
+#include "engine/quad_batch.h"
+
 Entity::Entity()
   : relative_transform_(1.0f),
     priority_(0.0f),
@@ -22,7 +24,7 @@ Entity::~Entity() {
   }
 }
 
-bool Entity::onScreen() {
+void Entity::screenExtent(glm::vec2 *min, glm::vec2 *max) {
   glm::vec2 corners[4];
   extent(corners, corners + 1);
   corners[2] = glm::vec2(corners[0].x, corners[1].y);
@@ -38,6 +40,13 @@ bool Entity::onScreen() {
     max_coords.x = std::max(transformed.x, max_coords.x);
     max_coords.y = std::max(transformed.y, max_coords.y);
   }
+  *min = min_coords;
+  *max = max_coords;
+}
+
+bool Entity::onScreen() {
+  glm::vec2 min_coords, max_coords;
+  screenExtent(&min_coords, &max_coords);
   return (max_coords.x > -1.0f && max_coords.y > -1.0f && min_coords.x < 1.0f && min_coords.y < 1.0f);
 }
 
@@ -62,28 +71,72 @@ struct PrioritySortFunctor {
   }
 };
 
-void Entity::drawAll() {
-  if (!isVisible()) return;
-  if (onScreen()) this->draw();
+// Walks the scene graph in draw order, flattening it into a list. Siblings drawn one after the other with
+// the same priority share a band, and may be reordered to save state changes. Everything else keeps its
+// order.
+void Entity::collectDraws(bool asOccluders, vector<DrawItem> *draws) {
+  if (!isVisible() || (asOccluders && !isOccluder())) return;
+  if (onScreen()) {
+    uint64_t band = 0;
+    if (!draws->empty()) {
+      const Entity *last = draws->back().entity;
+      band = draws->back().key >> kDrawStateBits;
+      if (last->parent_ != parent_ || last->priority_ != priority_) ++band;
+    }
+    DrawItem item;
+    item.key = (band << kDrawStateBits) | (drawKey(asOccluders) & ((static_cast<uint64_t>(1) << kDrawStateBits) - 1));
+    item.entity = this;
+    draws->push_back(item);
+  }
   // Get and sort the children by priority.
   vector<Entity *> sorted_drawables = children_;
   std::stable_sort(sorted_drawables.begin(), sorted_drawables.end(), PrioritySortFunctor());
   vector<Entity *>::iterator it;
   for (it = sorted_drawables.begin(); it != sorted_drawables.end(); ++it) {
-    (*it)->drawAll();
+    (*it)->collectDraws(asOccluders, draws);
+  }
+}
+
+// Least significant digit radix sort, a byte at a time. Stable, so equal keys keep their walk order.
+// Bytes every key agrees on are skipped, which is most of them.
+static void sortDraws(vector<DrawItem> *draws) {
+  vector<DrawItem> scratch(draws->size());
+  for (int shift = 0; shift < 64; shift += 8) {
+    size_t counts[257] = {0};
+    for (vector<DrawItem>::iterator it = draws->begin(); it != draws->end(); ++it) {
+      ++counts[((it->key >> shift) & 0xff) + 1];
+    }
+    if (counts[((draws->front().key >> shift) & 0xff) + 1] == draws->size()) continue;
+    for (int i = 1; i < 257; ++i) counts[i] += counts[i - 1];
+    for (vector<DrawItem>::iterator it = draws->begin(); it != draws->end(); ++it) {
+      scratch[counts[(it->key >> shift) & 0xff]++] = *it;
+    }
+    draws->swap(scratch);
+  }
+}
+
+void Entity::drawAll() {
+  vector<DrawItem> draws;
+  collectDraws(false, &draws);
+  if (draws.empty()) return;
+  sortDraws(&draws);
+  for (vector<DrawItem>::iterator it = draws.begin(); it != draws.end(); ++it) {
+    if (!it->entity->batchesDraws()) theQuadBatch().flush();
+    it->entity->draw();
   }
+  theQuadBatch().flush();
 }
 
 void Entity::drawAllOccluders() {
-  if (!isVisible() || !isOccluder()) return;
-  if (onScreen()) this->drawOccluder();
-  // Get and sort the children by priority.
-  vector<Entity *> sorted_drawables = children_;
-  std::stable_sort(sorted_drawables.begin(), sorted_drawables.end(), PrioritySortFunctor());
-  vector<Entity *>::iterator it;
-  for (it = sorted_drawables.begin(); it != sorted_drawables.end(); ++it) {
-    (*it)->drawAllOccluders();
+  vector<DrawItem> draws;
+  collectDraws(true, &draws);
+  if (draws.empty()) return;
+  sortDraws(&draws);
+  for (vector<DrawItem>::iterator it = draws.begin(); it != draws.end(); ++it) {
+    if (!it->entity->batchesDraws()) theQuadBatch().flush();
+    it->entity->drawOccluder();
   }
+  theQuadBatch().flush();
 }
 
 glm::mat3 Entity::fullTransform() {
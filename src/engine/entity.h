@@ -2,6 +2,7 @@
 #define SRC_ENTITY_H_
 
 #include <glm/glm.hpp>
+#include <stdint.h>
 #include <vector>
 
 using std::vector;
@@ -14,6 +15,24 @@ class Drawable {
 
 // Forward declaration of fill
 class Fill;
+class Entity;
+
+// Draw keys are a priority band in the high bits and the entity's draw state in the low ones. Draws are
+// sorted by key, so state only changes between runs of the same band.
+static const int kDrawStateBits = 40;
+
+// State half of a draw key, most expensive change first. Each field keeps its low 10 bits, plenty for the
+// handles GL hands out.
+inline uint64_t makeDrawKey(int pass, unsigned int program, unsigned int texture, unsigned int array_object) {
+  return (static_cast<uint64_t>(pass & 0x3ff) << 30) | (static_cast<uint64_t>(program & 0x3ff) << 20) |
+    (static_cast<uint64_t>(texture & 0x3ff) << 10) | (array_object & 0x3ff);
+}
+
+// An entity's spot in the flattened draw list.
+struct DrawItem {
+  uint64_t key;
+  Entity *entity;
+};
 
 // The Entity class provides some very minimal scene graph functionality.
 // All nodes that are decendents of Renderer::rootEntity() are drawn.
@@ -21,12 +40,16 @@ class Fill;
 class Entity : public Drawable {
   public:
     Entity();
-    ~Entity();
+    virtual ~Entity();
     // =====Virtuals=====
     virtual void update(float delta_time) {}
     virtual void draw() {}
     virtual void drawOccluder() {}
     virtual void extent(glm::vec2 *min, glm::vec2 *max) { *min = glm::vec2(0.0f); *max = glm::vec2(0.0f); }
+    // State this entity draws with, from makeDrawKey. Sorts it among draws in the same band.
+    virtual uint64_t drawKey(bool asOccluder) { return 0; }
+    // Whether draw() only queues into the quad batch. Anything else flushes the batch first.
+    virtual bool batchesDraws() { return false; }
 
     // Sets the drawable parent. Setting parent to NULL removes this entity
     // and all children from the scene graph.
@@ -41,6 +64,8 @@ class Entity : public Drawable {
     // We care about order cause we render in flatland.
     float displayPriority() const { return priority_; }
     void setDisplayPriority(float priority) { priority_ = priority; }
+    // Gets the extent transformed to screen coordinates, -1 to 1 on both axes.
+    void screenExtent(glm::vec2 *min, glm::vec2 *max);
     // Checks if shape extent is onscreen.
     bool onScreen();
     
@@ -75,6 +100,7 @@ class Entity : public Drawable {
     // Helpers
     void addChild(Entity *child);
     void removeChild(Entity *child);
+    void collectDraws(bool asOccluders, vector<DrawItem> *draws);
     // Member data.
     Entity *parent_;
     vector<Entity *> children_;
@@ -16,19 +16,74 @@ static glm::mat3 calcModelview(Entity *entity) {
   return entity->fullTransform() * modelview;
 }
 
-static void fillWithColor(Entity *entity, glm::vec4 color) {
-  theEngine().useProgram("minimal");
-  glUniform4fv(theEngine().uniformHandle("color"), 1, glm::value_ptr(color));
+// Uses the fill's program, or its variant for path triangles, and places the fill over the entity. Path
+// positions are taken to the unit square first, so textures line up the same as on the quad.
+static void useFillProgram(string program, unsigned int flags, Entity *entity, const PathGeometry *path) {
+  if (path == NULL) {
+    theEngine().useProgram(program, flags);
+  } else {
+    theEngine().useProgram(program, flags | PATH | (path->animated ? ANIMATED : 0));
+    glm::vec2 min, max;
+    entity->extent(&min, &max);
+    glm::mat3 to_unit(1.0f);
+    to_unit = scale2D(to_unit, 1.0f / (max - min));
+    to_unit = translate2D(to_unit, -min);
+    glUniformMatrix3fv(theEngine().uniformHandle("to_unit"), 1, GL_FALSE, glm::value_ptr(to_unit));
+    if (path->animated) {
+      glUniform1f(theEngine().uniformHandle("lerp_t1"), path->lerp_ts[0]);
+      glUniform1f(theEngine().uniformHandle("lerp_t2"), path->lerp_ts[1]);
+    }
+  }
   glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(calcModelview(entity)));
-  theEngine().drawUnitQuad();
+}
+
+static void drawFill(const PathGeometry *path) {
+  if (path == NULL) {
+    theEngine().drawUnitQuad();
+  } else {
+    glBindVertexArray(path->array_object);
+    glMultiDrawArrays(GL_TRIANGLES, path->firsts, path->counts, 2);
+  }
+}
+
+static void fillWithColor(Entity *entity, glm::vec4 color, const PathGeometry *path) {
+  useFillProgram("minimal", 0, entity, path);
+  glUniform4fv(theEngine().uniformHandle("color"), 1, glm::value_ptr(color));
+  drawFill(path);
 }
 
 void Fill::fillInOccluder(Entity *entity) {
-  fillWithColor(entity, glm::vec4(glm::vec3(entity->occluderColor()), 1.0f));
+  fillWithColor(entity, glm::vec4(glm::vec3(entity->occluderColor()), 1.0f), NULL);
+}
+
+void Fill::fillInPathOccluder(Entity *entity, const PathGeometry &path) {
+  fillWithColor(entity, glm::vec4(glm::vec3(entity->occluderColor()), 1.0f), &path);
+}
+
+void Fill::drawState(unsigned int flags, bool asOccluder, GLuint *program, GLuint *texture) {
+  *program = theEngine().programHandle("minimal", flags);
+  *texture = 0;
+}
+
+void Fill::quadStyle(Entity *entity, bool asOccluder, QuadStyle *style) {
+  style->texture = 0;
+  style->shadowed = false;
+  style->tex_scale = glm::vec2(1.0f);
+  style->color_mul = glm::vec4(0.0f);
+  style->color_add = glm::vec4(glm::vec3(entity->occluderColor()), 1.0f);
 }
 
 void ColoredFill::fillIn(Entity *entity) {
-  fillWithColor(entity, color_);
+  fillWithColor(entity, color_, NULL);
+}
+
+void ColoredFill::fillInPath(Entity *entity, const PathGeometry &path) {
+  fillWithColor(entity, color_, &path);
+}
+
+void ColoredFill::quadStyle(Entity *entity, bool asOccluder, QuadStyle *style) {
+  Fill::quadStyle(entity, asOccluder, style);
+  if (!asOccluder) style->color_add = color_;
 }
 
 TexturedFill::TexturedFill()
@@ -39,14 +94,12 @@ TexturedFill::TexturedFill()
     color_multiplier_(1.0f),
     color_addition_(0.0f) {}
 
-void TexturedFill::fillIn(Entity *entity) {
+void TexturedFill::fillHelper(Entity *entity, const PathGeometry *path) {
   glm::vec2 min, max, scale;
   entity->extent(&min, &max);
   scale = max - min;
 
-  string program = shadowed_ ? "textured_with_shadows" : "textured";
-  theEngine().useProgram(program);
-  glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(calcModelview(entity)));
+  useFillProgram("textured", shadowed_ ? SHADOWED : 0, entity, path);
   glUniform4fv(theEngine().uniformHandle("color_mul"), 1, glm::value_ptr(color_multiplier_));
   glUniform4fv(theEngine().uniformHandle("color_add"), 1, glm::value_ptr(color_addition_));
   if (stretched_) {
@@ -55,7 +108,27 @@ void TexturedFill::fillIn(Entity *entity) {
     glUniform2fv(theEngine().uniformHandle("tex_scale"), 1, glm::value_ptr(scale * texture_scale_));
   }
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture_handle_);
-  theEngine().drawUnitQuad();
+  theEngine().bindTexture(0, texture_handle_);
+  drawFill(path);
+}
+
+void TexturedFill::drawState(unsigned int flags, bool asOccluder, GLuint *program, GLuint *texture) {
+  if (asOccluder) {
+    Fill::drawState(flags, asOccluder, program, texture);
+    return;
+  }
+  *program = theEngine().programHandle("textured", flags | (shadowed_ ? SHADOWED : 0));
+  *texture = texture_handle_;
+}
+
+void TexturedFill::quadStyle(Entity *entity, bool asOccluder, QuadStyle *style) {
+  Fill::quadStyle(entity, asOccluder, style);
+  if (asOccluder) return;
+  glm::vec2 min, max;
+  entity->extent(&min, &max);
+  style->texture = texture_handle_;
+  style->shadowed = shadowed_;
+  style->tex_scale = stretched_ ? glm::vec2(1.0f) : (max - min) * texture_scale_;
+  style->color_mul = color_multiplier_;
+  style->color_add = color_addition_;
 }
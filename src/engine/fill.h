@@ -7,13 +7,33 @@
 
 #include "engine/entity.h"
 #include "engine/engine.h"
+#include "engine/quad_batch.h"
 
 using std::string;
 
+// Triangles that cover a path exactly, curves included, with the curve edges anti-aliased by the fill
+// shader. Filling these needs no stencil and no quad.
+struct PathGeometry {
+  GLuint array_object;
+  // Solid and curve triangles sit apart in the buffer, so they go in as two ranges.
+  GLint firsts[2];
+  GLsizei counts[2];
+  // Animated paths blend between three keyframes.
+  bool animated;
+  float lerp_ts[2];
+};
+
 class Fill {
   public:
     virtual void fillIn(Entity *entity) = 0;
     virtual void fillInOccluder(Entity *entity);
+    virtual void fillInPath(Entity *entity, const PathGeometry &path) = 0;
+    virtual void fillInPathOccluder(Entity *entity, const PathGeometry &path);
+    // Program and texture the fill will draw with, for sorting draws. Flags are the shader flags of the
+    // geometry, PATH and ANIMATED for path triangles and none for the quad.
+    virtual void drawState(unsigned int flags, bool asOccluder, GLuint *program, GLuint *texture);
+    // How the fill looks on a batched quad. Fills default to their occluder look.
+    virtual void quadStyle(Entity *entity, bool asOccluder, QuadStyle *style);
 };
 
 class ColoredFill : public Fill {
@@ -23,6 +43,8 @@ class ColoredFill : public Fill {
     void init(glm::vec4 color) { setColor(color); }
     void setColor(glm::vec4 color) { color_ = color; }
     void fillIn(Entity *entity);
+    void fillInPath(Entity *entity, const PathGeometry &path);
+    void quadStyle(Entity *entity, bool asOccluder, QuadStyle *style);
   private:
     glm::vec4 color_;
 };
@@ -43,8 +65,12 @@ class TexturedFill : public Fill {
     void setColorAddition(glm::vec4 color_addition) { color_addition_ = color_addition; }
     bool shadowed() { return shadowed_; }
     void setShadowed(bool shadowed) { shadowed_ = shadowed; }
-    void fillIn(Entity *entity);
+    void fillIn(Entity *entity) { fillHelper(entity, NULL); }
+    void fillInPath(Entity *entity, const PathGeometry &path) { fillHelper(entity, &path); }
+    void drawState(unsigned int flags, bool asOccluder, GLuint *program, GLuint *texture);
+    void quadStyle(Entity *entity, bool asOccluder, QuadStyle *style);
   private:
+    void fillHelper(Entity *entity, const PathGeometry *path);
     bool shadowed_;
     bool stretched_;
     GLuint texture_handle_;
@@ -0,0 +1,182 @@
+#include "engine/glyph_cache.h"
+
+#include <cmath>
+#include <limits>
+
+#include "engine/engine.h"
+#include "util/error.h"
+
+// Empty pixels around each glyph so linear filtering never pulls in a neighbour.
+static const int kGlyphPadding = 1;
+
+GlyphCache &theGlyphCache() {
+  static GlyphCache *glyph_cache = new GlyphCache();
+  return *glyph_cache;
+}
+
+bool GlyphCache::Key::operator<(const Key &other) const {
+  if (face != other.face) return face < other.face;
+  if (pixel_size != other.pixel_size) return pixel_size < other.pixel_size;
+  if (index != other.index) return index < other.index;
+  return distance_field < other.distance_field;
+}
+
+GlyphCache::GlyphCache()
+  : generation_(0),
+    texture_(0) {}
+
+GlyphCache::~GlyphCache() {}
+
+void GlyphCache::init() {
+  glGenTextures(1, &texture_);
+  theEngine().bindTexture(0, texture_);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  clear();
+}
+
+// Clears the texture too, or padding would pick up old glyphs.
+void GlyphCache::clear() {
+  vector<unsigned char> zeros(kAtlasSize * kAtlasSize, 0);
+  theEngine().bindTexture(0, texture_);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, kAtlasSize, kAtlasSize, 0, GL_RED, GL_UNSIGNED_BYTE, &zeros[0]);
+  glyphs_.clear();
+  shelves_.clear();
+  ++generation_;
+}
+
+// Tries the shelves that are tall enough, and opens a new one below the last if none has room.
+bool GlyphCache::pack(int width, int height, glm::ivec2 *corner) {
+  for (vector<Shelf>::iterator it = shelves_.begin(); it != shelves_.end(); ++it) {
+    if (height <= it->height && it->x + width <= kAtlasSize) {
+      *corner = glm::ivec2(it->x, it->y);
+      it->x += width;
+      return true;
+    }
+  }
+  int y = shelves_.empty() ? 0 : shelves_.back().y + shelves_.back().height;
+  if (y + height > kAtlasSize || width > kAtlasSize) return false;
+  Shelf shelf = {y, height, width};
+  shelves_.push_back(shelf);
+  *corner = glm::ivec2(0, y);
+  return true;
+}
+
+// Felzenszwalb and Huttenlocher's squared distance transform along one row or column. Takes squared
+// distances of length count, every stride apart, and replaces them with the lower envelope of the
+// parabolas rooted at each.
+static void distanceTransform1D(float *distances, int count, int stride) {
+  vector<float> values(count), boundaries(count + 1);
+  vector<int> roots(count);
+  for (int i = 0; i < count; ++i) values[i] = distances[i * stride];
+  int envelope = 0;
+  roots[0] = 0;
+  boundaries[0] = -std::numeric_limits<float>::max();
+  boundaries[1] = std::numeric_limits<float>::max();
+  for (int q = 1; q < count; ++q) {
+    // Drop parabolas the new one hides completely.
+    int r = roots[envelope];
+    float s = ((values[q] + q * q) - (values[r] + r * r)) / (2.0f * (q - r));
+    while (s <= boundaries[envelope]) {
+      --envelope;
+      r = roots[envelope];
+      s = ((values[q] + q * q) - (values[r] + r * r)) / (2.0f * (q - r));
+    }
+    ++envelope;
+    roots[envelope] = q;
+    boundaries[envelope] = s;
+    boundaries[envelope + 1] = std::numeric_limits<float>::max();
+  }
+  envelope = 0;
+  for (int q = 0; q < count; ++q) {
+    while (boundaries[envelope + 1] < q) ++envelope;
+    int r = roots[envelope];
+    distances[q * stride] = (q - r) * (q - r) + values[r];
+  }
+}
+
+// Squared distance from every pixel to the nearest one marked zero, rows then columns.
+static void distanceTransform(vector<float> *distances, int width, int height) {
+  for (int y = 0; y < height; ++y) distanceTransform1D(&(*distances)[y * width], width, 1);
+  for (int x = 0; x < width; ++x) distanceTransform1D(&(*distances)[x], height, width);
+}
+
+// Pads the coverage bitmap by the spread and turns it into a distance field, measured from the centers
+// of the pixels inside and outside the outline.
+static void makeDistanceField(const FT_Bitmap &bitmap, int spread, vector<unsigned char> *field) {
+  int width = bitmap.width + 2 * spread, height = bitmap.rows + 2 * spread;
+  float far = static_cast<float>(width * width + height * height);
+  vector<float> to_inside(width * height, far), to_outside(width * height, 0.0f);
+  for (int y = 0; y < static_cast<int>(bitmap.rows); ++y) {
+    for (int x = 0; x < static_cast<int>(bitmap.width); ++x) {
+      if (bitmap.buffer[y * bitmap.pitch + x] < 128) continue;
+      int index = (y + spread) * width + x + spread;
+      to_inside[index] = 0.0f;
+      to_outside[index] = far;
+    }
+  }
+  distanceTransform(&to_inside, width, height);
+  distanceTransform(&to_outside, width, height);
+  field->resize(width * height);
+  for (int i = 0; i < width * height; ++i) {
+    // Half a pixel each way puts the outline between the last pixel in and the first out.
+    float distance = to_inside[i] > 0.0f ? 0.5f - sqrtf(to_inside[i]) : sqrtf(to_outside[i]) - 0.5f;
+    float value = 0.5f + 0.5f * distance / spread;
+    (*field)[i] = static_cast<unsigned char>(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+  }
+}
+
+// Packs the glyph's pixels, clearing and packing again if the atlas is full.
+void GlyphCache::upload(const unsigned char *pixels, int pitch, Glyph *glyph) {
+  glm::ivec2 corner;
+  if (!pack(glyph->size.x + kGlyphPadding, glyph->size.y + kGlyphPadding, &corner)) {
+    clear();
+    if (!pack(glyph->size.x + kGlyphPadding, glyph->size.y + kGlyphPadding, &corner)) {
+      error("Glyph of %d by %d pixels doesn't fit in the glyph atlas.\n", glyph->size.x, glyph->size.y);
+    }
+  }
+  theEngine().bindTexture(0, texture_);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, corner.x, corner.y, glyph->size.x, glyph->size.y, GL_RED, GL_UNSIGNED_BYTE,
+    pixels);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glyph->tex_min = glm::vec2(corner) / static_cast<float>(kAtlasSize);
+  glyph->tex_max = glm::vec2(corner + glyph->size) / static_cast<float>(kAtlasSize);
+}
+
+const Glyph &GlyphCache::glyph(FT_Face face, int pixel_size, FT_UInt index, bool distance_field) {
+  if (texture_ == 0) init();
+  FT_Set_Pixel_Sizes(face, pixel_size, pixel_size);
+  Key key = {face, pixel_size, index, distance_field};
+  map<Key, Glyph>::iterator found = glyphs_.find(key);
+  if (found != glyphs_.end()) return found->second;
+
+  Glyph glyph;
+  glyph.offset = glyph.size = glm::ivec2(0);
+  glyph.advance = 0;
+  glyph.tex_min = glyph.tex_max = glm::vec2(0.0f);
+  if (FT_Load_Glyph(face, index, FT_LOAD_RENDER)) {
+    // Cache the failure too, it'll just draw nothing.
+    return glyphs_[key] = glyph;
+  }
+  FT_GlyphSlot slot = face->glyph;
+  glyph.offset = glm::ivec2(slot->bitmap_left, slot->bitmap_top);
+  glyph.size = glm::ivec2(slot->bitmap.width, slot->bitmap.rows);
+  glyph.advance = slot->advance.x >> 6;
+  if (glyph.size.x > 0 && glyph.size.y > 0) {
+    if (distance_field) {
+      vector<unsigned char> field;
+      makeDistanceField(slot->bitmap, kDistanceFieldSpread, &field);
+      glyph.offset += glm::ivec2(-kDistanceFieldSpread, kDistanceFieldSpread);
+      glyph.size += glm::ivec2(2 * kDistanceFieldSpread);
+      upload(&field[0], glyph.size.x, &glyph);
+    } else {
+      upload(slot->bitmap.buffer, slot->bitmap.pitch, &glyph);
+    }
+  }
+  return glyphs_[key] = glyph;
+}
@@ -0,0 +1,72 @@
+#ifndef SRC_GLYPH_CACHE_H_
+#define SRC_GLYPH_CACHE_H_
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <map>
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+using std::map;
+using std::vector;
+
+// A rasterized glyph's spot in the atlas.
+struct Glyph {
+  // Bitmap corner from the pen position and bitmap size, in pixels with y up. Top left is offset.
+  glm::ivec2 offset, size;
+  int advance;
+  // Atlas coordinates of the bitmap's top left and bottom right.
+  glm::vec2 tex_min, tex_max;
+};
+
+class GlyphCache;
+
+GlyphCache &theGlyphCache();
+
+// Every glyph any text has drawn, rasterized once and packed into one shared texture. Glyphs are packed
+// on shelves, rows as tall as the first glyph placed in them. When the atlas fills up it is emptied and
+// the generation bumped, so text knows to look its glyphs up again.
+//
+// Distance field glyphs store, instead of coverage, how far each texel is from the outline. 0.5 is on
+// the outline and higher is inside, reaching 0 and 1 kDistanceFieldSpread pixels out. Thresholding
+// that stays sharp at any scale, so they're all rendered at one size.
+class GlyphCache {
+  public:
+    static const int kAtlasSize = 1024;
+    static const int kDistanceFieldSize = 48;
+    static const int kDistanceFieldSpread = 6;
+    GlyphCache();
+    ~GlyphCache();
+    // Rasterizes the glyph on a miss. Leaves the face set to the pixel size. Distance field glyphs have
+    // the spread included in their offset and size.
+    const Glyph &glyph(FT_Face face, int pixel_size, FT_UInt index, bool distance_field = false);
+    GLuint texture() { return texture_; }
+    int generation() { return generation_; }
+
+  private:
+    struct Key {
+      FT_Face face;
+      int pixel_size;
+      FT_UInt index;
+      bool distance_field;
+      bool operator<(const Key &other) const;
+    };
+    struct Shelf {
+      int y, height;
+      // Where the next glyph goes.
+      int x;
+    };
+    void init();
+    bool pack(int width, int height, glm::ivec2 *corner);
+    void clear();
+    void upload(const unsigned char *pixels, int pitch, Glyph *glyph);
+    // Member data.
+    map<Key, Glyph> glyphs_;
+    vector<Shelf> shelves_;
+    int generation_;
+    GLuint texture_;
+};
+
+#endif  // SRC_GLYPH_CACHE_H_
@@ -0,0 +1,65 @@
+#include "engine/particle_budget.h"
+
+#include <algorithm>
+
+#include "engine/particle_system.h"
+
+static const int kDefaultMaxParticles = 100000;
+static const float kDefaultFrameBudget = 1.0f / 30.0f;
+// Never cut below this fraction of the max.
+static const float kMinCapFraction = 0.05f;
+// Cut quickly when over budget, grow back slowly, so we don't bounce around the limit.
+static const float kShrinkPerFrame = 0.95f;
+static const float kGrowPerFrame = 0.005f;
+// Only grow with some headroom under the budget.
+static const float kGrowBelow = 0.8f;
+static const float kFrameTimeSmoothing = 0.1f;
+
+ParticleBudget &theParticleBudget() {
+  // Never deleted, particle systems can outlive everything else at exit.
+  static ParticleBudget *the_particle_budget = new ParticleBudget();
+  return *the_particle_budget;
+}
+
+ParticleBudget::ParticleBudget()
+  : max_particles_(kDefaultMaxParticles),
+    cap_(kDefaultMaxParticles),
+    frame_budget_(kDefaultFrameBudget),
+    frame_time_(0.0f) {}
+
+ParticleBudget::~ParticleBudget() {}
+
+void ParticleBudget::setMaxParticles(int particles) {
+  max_particles_ = particles;
+  cap_ = std::min(cap_, max_particles_);
+}
+
+void ParticleBudget::addSystem(ParticleSystem *system) {
+  systems_.push_back(system);
+}
+
+void ParticleBudget::removeSystem(ParticleSystem *system) {
+  systems_.erase(std::remove(systems_.begin(), systems_.end(), system), systems_.end());
+}
+
+void ParticleBudget::update(float frame_time) {
+  frame_time_ += (frame_time - frame_time_) * kFrameTimeSmoothing;
+  int min_cap = static_cast<int>(max_particles_ * kMinCapFraction);
+  if (frame_time_ > frame_budget_) {
+    cap_ = std::max(min_cap, static_cast<int>(cap_ * kShrinkPerFrame));
+  } else if (frame_time_ < frame_budget_ * kGrowBelow) {
+    cap_ = std::min(max_particles_, cap_ + std::max(1, static_cast<int>(max_particles_ * kGrowPerFrame)));
+  }
+
+  // Everyone gets what they want if it fits, otherwise shares in proportion to what they want.
+  vector<float> demands;
+  float total_demand = 0.0f;
+  for (vector<ParticleSystem *>::iterator it = systems_.begin(); it != systems_.end(); ++it) {
+    demands.push_back((*it)->budgetDemand());
+    total_demand += demands.back();
+  }
+  float share = total_demand > cap_ ? cap_ / total_demand : 1.0f;
+  for (size_t i = 0; i < systems_.size(); ++i) {
+    systems_[i]->setBudget(demands[i] * share);
+  }
+}
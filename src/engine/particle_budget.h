@@ -0,0 +1,39 @@
+#ifndef SRC_PARTICLE_BUDGET_H_
+#define SRC_PARTICLE_BUDGET_H_
+
+#include <vector>
+
+using std::vector;
+
+class ParticleSystem;
+class ParticleBudget;
+
+ParticleBudget &theParticleBudget();
+
+// One cap on live particles shared by every particle system. Each frame the cap is split between
+// systems by how many particles their visible, on screen emitters want, and each system splits its share
+// between emitters, see ParticleSystem::setBudget. The cap shrinks while frames run over the frame
+// budget and creeps back up once they're under it again. Systems register themselves on init.
+class ParticleBudget {
+  public:
+    ParticleBudget();
+    ~ParticleBudget();
+    // The most the cap grows back to.
+    void setMaxParticles(int particles);
+    // Seconds a frame may take before we start cutting particles.
+    void setFrameBudget(float seconds) { frame_budget_ = seconds; }
+    int cap() { return cap_; }
+    void addSystem(ParticleSystem *system);
+    void removeSystem(ParticleSystem *system);
+    // Once a frame, before systems update, with how long the last frame took.
+    void update(float frame_time);
+
+  private:
+    int max_particles_, cap_;
+    float frame_budget_;
+    // Smoothed, so one slow frame doesn't throw particles away.
+    float frame_time_;
+    vector<ParticleSystem *> systems_;
+};
+
+#endif  // SRC_PARTICLE_BUDGET_H_
@@ -3,43 +3,105 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <algorithm>
+#include <cmath>
+#include <cstddef>
 
-#include "util/random.h"
+#include "engine/cpu_particles.h"
+#include "engine/particle_budget.h"
+#include "util/error.h"
+#include "util/transform2D.h"
 
 static const float kParticleLifetime = 1.2f;
 static const float kParticleAlphaDecay = 0.5f;
+static const float kParticleSpawnSpeed = 0.02f;
+// How far past the screen edge an emitter still counts as on screen, its particles drift a little.
+static const float kOffscreenMargin = 0.1f;
+// Cut down emitters grow their particles up to this much.
+static const float kMaxSizeScale = 3.0f;
 
+// Emitting a full emitter's worth over a lifetime keeps it at kParticlesPerEmitter.
 Emitter::Emitter()
   : visible_(false),
     position_(0.0f),
     color_(0.0f),
-    current_source_(0),
-    current_dest_(1),
-    num_particles_(0) {}
+    rate_(ParticleSystem::kParticlesPerEmitter / kParticleLifetime),
+    priority_(1.0f),
+    budget_fraction_(1.0f) {}
 
 Emitter::~Emitter() {}
 
-void Emitter::init(int num_particles) {
-  num_particles_ = num_particles;
-  glGenVertexArrays(2, array_objects_);
-  glGenBuffers(2, buffer_objects_);
-  //glGenTransformFeedbacks(2, transform_feedbacks_);
+// Keeps the area covered by all its particles about the same.
+float Emitter::sizeScale() {
+  if (budget_fraction_ <= 0.0f) return 1.0f;
+  return glm::clamp(1.0f / sqrtf(budget_fraction_), 1.0f, kMaxSizeScale);
+}
+
+ParticleSystem::ParticleSystem()
+  : capacity_(0),
+    current_source_(0),
+    current_dest_(1),
+    simulated_(false),
+    instanced_(false),
+    weighted_transparency_(false),
+    draw_feedback_(false),
+    counted_(false),
+    count_pending_(false),
+    live_count_(0),
+    gravity_(0.0f),
+    drag_(0.0f),
+    collision_radius_(0.0f),
+    use_heightfield_(false),
+    heightfield_range_(0.0f),
+    seed_(0),
+    cpu_particles_(NULL),
+    heightfield_texture_(0),
+    transparency_frame_buffer_(0),
+    transparency_size_(0) {
+  projection_ = glm::perspective(35.0f, 1.0f, 0.1f, 100.0f);
+  inverse_projection_ = glm::inverse(projection_);
+}
+
+ParticleSystem::~ParticleSystem() {
+  delete cpu_particles_;
+  if (capacity_ == 0) return;
+  theParticleBudget().removeSystem(this);
+  glDeleteVertexArrays(2, array_objects_);
+  glDeleteVertexArrays(2, billboard_arrays_);
+  glDeleteBuffers(2, buffer_objects_);
+  glDeleteBuffers(1, &corner_buffer_);
+  glDeleteBuffers(1, &emitter_buffer_);
+  if (draw_feedback_) glDeleteTransformFeedbacks(2, transform_feedbacks_);
+  glDeleteQueries(1, &count_query_);
+  glDeleteTextures(1, &emitter_texture_);
+  if (heightfield_texture_ != 0) glDeleteTextures(1, &heightfield_texture_);
+  if (transparency_frame_buffer_ != 0) {
+    glDeleteFramebuffers(1, &transparency_frame_buffer_);
+    glDeleteTextures(2, transparency_textures_);
+  }
+  theEngine().forgetTextures();
+}
 
-  Particle *particles = new Particle[num_particles];
-  float age = 0.0f;
-  for (int i = 0; i < num_particles; ++i) {
-    Particle &particle = particles[i];
-    particle.position = glm::vec3();
-    particle.velocity = 0.02f * randomDirection3D();
-    particle.color = glm::vec4();
-    particle.age = (kParticleLifetime * i) / (num_particles - 1);
-    particle.visible = 0.0f;
+void ParticleSystem::init(int num_emitters, int capacity, ParticleBackend backend) {
+  texture_handle_ = theEngine().getTexture("content/textures/particle.dds");
+  emitters_.resize(num_emitters);
+  capacity_ = capacity > 0 ? capacity : num_emitters * kParticlesPerEmitter;
+  // The spawn pass runs one vertex per emitter from the source buffer, so it needs at least that many.
+  capacity_ = std::max(capacity_, num_emitters);
+  theParticleBudget().addSystem(this);
+  // CPU particles are drawn from what they upload, counted as they go.
+  draw_feedback_ = backend == GPU_PARTICLES && GLEW_ARB_transform_feedback2 != 0;
+  if (backend == CPU_PARTICLES) {
+    cpu_particles_ = new CpuParticles();
+    cpu_particles_->init(capacity_);
   }
 
+  // Buffers start empty, emitters fill them.
+  glGenVertexArrays(2, array_objects_);
+  glGenBuffers(2, buffer_objects_);
   for (int i = 0; i < 2; i++) {
     glBindVertexArray(array_objects_[i]);
     glBindBuffer(GL_ARRAY_BUFFER, buffer_objects_[i]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Particle) * num_particles, particles, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Particle) * capacity_, NULL, GL_DYNAMIC_DRAW);
     // VAO varyings.
     GLuint handle = theEngine().attributeHandle("position");
     glEnableVertexAttribArray(handle);
@@ -56,91 +118,379 @@ void Emitter::init(int num_particles) {
     handle = theEngine().attributeHandle("visible");
     glEnableVertexAttribArray(handle);
     glVertexAttribPointer(handle, 1, GL_FLOAT, GL_FALSE, sizeof(Particle), (void *)offsetof(Particle, visible));
-    // Transform feedback init.
-    //glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, transform_feedbacks_[i]);
-    //glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer_objects_[i]);
+    handle = theEngine().attributeHandle("emitter");
+    glEnableVertexAttribArray(handle);
+    glVertexAttribIPointer(handle, 1, GL_INT, sizeof(Particle), (void *)offsetof(Particle, emitter));
+  }
+
+  // Billboard corners in strip order, then the particle attributes advancing once per instance.
+  glm::vec2 corners[4] = {glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(0.0f, 1.0f), glm::vec2(1.0f, 1.0f)};
+  glGenBuffers(1, &corner_buffer_);
+  glBindBuffer(GL_ARRAY_BUFFER, corner_buffer_);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+  glGenVertexArrays(2, billboard_arrays_);
+  for (int i = 0; i < 2; i++) {
+    glBindVertexArray(billboard_arrays_[i]);
+    glBindBuffer(GL_ARRAY_BUFFER, corner_buffer_);
+    GLuint handle = theEngine().attributeHandle("tex_coord");
+    glEnableVertexAttribArray(handle);
+    glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_objects_[i]);
+    handle = theEngine().attributeHandle("position");
+    glEnableVertexAttribArray(handle);
+    glVertexAttribPointer(handle, 3, GL_FLOAT, GL_FALSE, sizeof(Particle), (void *)offsetof(Particle, position));
+    glVertexAttribDivisor(handle, 1);
+    handle = theEngine().attributeHandle("color");
+    glEnableVertexAttribArray(handle);
+    glVertexAttribPointer(handle, 4, GL_FLOAT, GL_FALSE, sizeof(Particle), (void *)offsetof(Particle, color));
+    glVertexAttribDivisor(handle, 1);
+    handle = theEngine().attributeHandle("visible");
+    glEnableVertexAttribArray(handle);
+    glVertexAttribPointer(handle, 1, GL_FLOAT, GL_FALSE, sizeof(Particle), (void *)offsetof(Particle, visible));
+    glVertexAttribDivisor(handle, 1);
+    handle = theEngine().attributeHandle("emitter");
+    glEnableVertexAttribArray(handle);
+    glVertexAttribIPointer(handle, 1, GL_INT, sizeof(Particle), (void *)offsetof(Particle, emitter));
+    glVertexAttribDivisor(handle, 1);
   }
-  delete particles;
-  
+  glBindVertexArray(0);
+  // Transform feedback init.
+  if (draw_feedback_) {
+    glGenTransformFeedbacks(2, transform_feedbacks_);
+    for (int i = 0; i < 2; i++) {
+      glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, transform_feedbacks_[i]);
+      glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer_objects_[i]);
+    }
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+  }
+  glGenQueries(1, &count_query_);
+
+  // Position and visibility, color, then emission rate and size scale, per emitter.
+  glGenBuffers(1, &emitter_buffer_);
+  glBindBuffer(GL_TEXTURE_BUFFER, emitter_buffer_);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * 3 * num_emitters, NULL, GL_STREAM_DRAW);
+  glGenTextures(1, &emitter_texture_);
+  theEngine().bindTexture(1, emitter_texture_, GL_TEXTURE_BUFFER);
+  glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, emitter_buffer_);
+
   theEngine().useProgram("particle_feedback");
   glUniform1f(theEngine().uniformHandle("alpha_decay"), kParticleAlphaDecay);
   glUniform1f(theEngine().uniformHandle("lifetime"), kParticleLifetime);
+  glUniform1f(theEngine().uniformHandle("spawn_speed"), kParticleSpawnSpeed);
+  glUniformMatrix4fv(theEngine().uniformHandle("projection"), 1, GL_FALSE, glm::value_ptr(projection_));
+  glUniformMatrix4fv(theEngine().uniformHandle("inverse_projection"), 1, GL_FALSE, glm::value_ptr(inverse_projection_));
+  const char *draw_programs[] = {"particle_draw", "particle_billboard"};
+  unsigned int draw_flags[] = {0, WEIGHTED_OIT};
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 2; ++j) {
+      theEngine().useProgram(draw_programs[i], draw_flags[j]);
+      glUniform1f(theEngine().uniformHandle("particle_radius"), 0.012f);
+      glUniform3fv(theEngine().uniformHandle("camera_position"), 1, glm::value_ptr(glm::vec3(0.0f)));
+    }
+  }
 }
 
-void Emitter::update(float delta_time) {
-  theEngine().useProgram("particle_feedback");
-  glUniform3fv(theEngine().uniformHandle("emitter_position"), 1, glm::value_ptr(position_));
-  glUniform4fv(theEngine().uniformHandle("emitter_color"), 1, glm::value_ptr(color_));
-  glUniform1f(theEngine().uniformHandle("emitter_visible"), visible_ ? 1.0f : 0.0f);
-  glUniform1f(theEngine().uniformHandle("delta_time"), delta_time);
+void ParticleSystem::setContainerCircles(const vector<glm::vec3> &circles) {
+  if (circles.size() > kMaxContainerCircles) {
+    error("Particle systems collide with at most %d circles, not %d.\n", kMaxContainerCircles, (int)circles.size());
+  }
+  container_circles_ = circles;
+}
 
-  //glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, transform_feedbacks_[current_dest_]);
-  glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer_objects_[current_dest_]);
-  glBindVertexArray(array_objects_[current_source_]);
+void ParticleSystem::setHeightfield(const vector<float> &heights, float min_x, float max_x) {
+  if (heights.empty()) error("Particle heightfields need at least one height.\n");
+  if (heightfield_texture_ == 0) {
+    glGenTextures(1, &heightfield_texture_);
+    theEngine().bindTexture(2, heightfield_texture_);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  }
+  theEngine().bindTexture(2, heightfield_texture_);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, heights.size(), 1, 0, GL_RED, GL_FLOAT, &heights[0]);
+  use_heightfield_ = true;
+  heightfield_range_ = glm::vec2(min_x, max_x);
+  heights_ = heights;
+}
 
-  glEnable(GL_RASTERIZER_DISCARD);
-  glBeginTransformFeedback(GL_POINTS);
-  glDrawArrays(GL_POINTS, 0, num_particles_);
-  glEndTransformFeedback();
-  glDisable(GL_RASTERIZER_DISCARD);
+float ParticleSystem::screenWeight(int index) {
+  Emitter &emitter = emitters_[index];
+  if (!emitter.visible()) return 0.0f;
+  glm::vec4 projected = projection_ * transform3D_ * glm::vec4(emitter.position(), 1.0f);
+  if (projected.w <= 0.0f) return 0.0f;
+  glm::vec3 screen = theEngine().rootEntity()->fullTransform() * transform2D_ *
+    glm::vec3(glm::vec2(projected) / projected.w, 1.0f);
+  float edge = 1.0f + kOffscreenMargin;
+  if (fabsf(screen.x) > edge || fabsf(screen.y) > edge) return 0.0f;
+  // Billboards shrink with distance.
+  return 1.0f / projected.w;
+}
 
-  current_source_ = (current_source_ + 1) % 2;
-  current_dest_ = (current_dest_ + 1) % 2;
+float ParticleSystem::budgetDemand() {
+  float demand = 0.0f;
+  for (size_t i = 0; i < emitters_.size(); ++i) {
+    if (screenWeight(i) > 0.0f) demand += emitters_[i].rate() * kParticleLifetime;
+  }
+  return demand;
 }
 
-void Emitter::drawArray() {
-  glBindVertexArray(array_objects_[current_source_]);
-  glDrawArrays(GL_POINTS, 0, num_particles_);
+// Shares go by priority times screen weight times want. Emitters whose share is more than they want are
+// capped at what they want and the rest shared again, until no one is over.
+void ParticleSystem::setBudget(float particles) {
+  size_t num_emitters = emitters_.size();
+  vector<float> weights(num_emitters), wants(num_emitters);
+  for (size_t i = 0; i < num_emitters; ++i) {
+    weights[i] = emitters_[i].priority() * screenWeight(i);
+    wants[i] = weights[i] > 0.0f ? emitters_[i].rate() * kParticleLifetime : 0.0f;
+  }
+  vector<bool> full(num_emitters, false);
+  float remaining = particles, weighted_wants = 0.0f;
+  bool capped = true;
+  while (capped) {
+    capped = false;
+    weighted_wants = 0.0f;
+    for (size_t i = 0; i < num_emitters; ++i) {
+      if (!full[i]) weighted_wants += weights[i] * wants[i];
+    }
+    if (weighted_wants <= 0.0f) break;
+    // Capping only lowers the bar for the rest, so everything over it this round can go at once.
+    float capped_wants = 0.0f;
+    for (size_t i = 0; i < num_emitters; ++i) {
+      if (full[i] || wants[i] <= 0.0f || remaining * weights[i] < weighted_wants) continue;
+      full[i] = true;
+      capped_wants += wants[i];
+      capped = true;
+    }
+    remaining -= capped_wants;
+  }
+  for (size_t i = 0; i < num_emitters; ++i) {
+    float fraction = 0.0f;
+    if (full[i]) {
+      fraction = 1.0f;
+    } else if (wants[i] > 0.0f && weighted_wants > 0.0f) {
+      fraction = std::min(1.0f, remaining * weights[i] / weighted_wants);
+    }
+    emitters_[i].setBudgetFraction(fraction);
+  }
 }
 
-ParticleSystem::ParticleSystem() {
-  projection_ = glm::perspective(35.0f, 1.0f, 0.1f, 100.0f);
-  inverse_projection_ = glm::inverse(projection_);
+void ParticleSystem::uploadEmitters() {
+  vector<glm::vec4> parameters;
+  parameters.reserve(3 * emitters_.size());
+  for (vector<Emitter>::iterator it = emitters_.begin(); it != emitters_.end(); ++it) {
+    parameters.push_back(glm::vec4(it->position(), it->visible() ? 1.0f : 0.0f));
+    parameters.push_back(it->color());
+    parameters.push_back(glm::vec4(it->budgetedRate(), it->sizeScale(), 0.0f, 0.0f));
+  }
+  // Orphan last frame's parameters rather than wait on the update still reading them.
+  glBindBuffer(GL_TEXTURE_BUFFER, emitter_buffer_);
+  glBufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4) * parameters.size(), &parameters[0], GL_STREAM_DRAW);
 }
 
-ParticleSystem::~ParticleSystem() {}
+GLuint ParticleSystem::liveCount() {
+  if (count_pending_) {
+    glGetQueryObjectuiv(count_query_, GL_QUERY_RESULT, &live_count_);
+    count_pending_ = false;
+  }
+  return counted_ ? live_count_ : 0;
+}
 
-void ParticleSystem::init(int num_emitters) {
-  texture_handle_ = theEngine().getTexture("content/textures/particle.dds");
-  emitters_.resize(num_emitters);
-  for (int i = 0; i < num_emitters; ++i) {
-    emitters_[i].init(300);
-    emitters_by_depth_.push_back(i);
+void ParticleSystem::drawLive() {
+  glBindVertexArray(array_objects_[current_source_]);
+  if (draw_feedback_) {
+    glDrawTransformFeedback(GL_POINTS, transform_feedbacks_[current_source_]);
+  } else {
+    glDrawArrays(GL_POINTS, 0, liveCount());
   }
-  theEngine().useProgram("particle_draw");
-  glUniform1f(theEngine().uniformHandle("particle_radius"), 0.012f);
-  glUniform3fv(theEngine().uniformHandle("camera_position"), 1, glm::value_ptr(glm::vec3(0.0f)));
+}
+
+void ParticleSystem::drawBillboards() {
+  glBindVertexArray(billboard_arrays_[current_source_]);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, liveCount());
 }
 
 void ParticleSystem::update(float delta_time) {
-  for (vector<Emitter>::iterator it = emitters_.begin(); it != emitters_.end(); ++it) {
-    it->update(delta_time);
+  if (emitters_.empty()) return;
+  // Drawing reads sizes from here too, so the CPU backend needs it as well.
+  uploadEmitters();
+  if (cpu_particles_ != NULL) {
+    updateCpu(delta_time);
+  } else {
+    updateFeedback(delta_time);
   }
+  simulated_ = true;
+  current_source_ = (current_source_ + 1) % 2;
+  current_dest_ = (current_dest_ + 1) % 2;
 }
 
+// Live particles first, then each emitter's spawns appended after them in the same feedback pass.
+void ParticleSystem::updateFeedback(float delta_time) {
+  theEngine().useProgram("particle_feedback");
+  glUniform1f(theEngine().uniformHandle("delta_time"), delta_time);
+  glUniform1ui(theEngine().uniformHandle("seed"), seed_++);
+  glUniform3fv(theEngine().uniformHandle("gravity"), 1, glm::value_ptr(gravity_));
+  glUniform1f(theEngine().uniformHandle("drag"), drag_);
+  glUniform1f(theEngine().uniformHandle("collision_radius"), collision_radius_);
+  glUniform1i(theEngine().uniformHandle("num_container_circles"), container_circles_.size());
+  if (!container_circles_.empty()) {
+    glUniform3fv(theEngine().uniformHandle("container_circles"), container_circles_.size(),
+      glm::value_ptr(container_circles_[0]));
+  }
+  glUniform1i(theEngine().uniformHandle("use_heightfield"), use_heightfield_);
+  if (use_heightfield_) {
+    glUniform2fv(theEngine().uniformHandle("heightfield_range"), 1, glm::value_ptr(heightfield_range_));
+    glUniform1i(theEngine().uniformHandle("heightfield_size"), heights_.size());
+    glUniformMatrix3fv(theEngine().uniformHandle("transform2D"), 1, GL_FALSE, glm::value_ptr(transform2D_));
+    glUniformMatrix3fv(theEngine().uniformHandle("inverse_transform2D"), 1, GL_FALSE,
+      glm::value_ptr(glm::inverse(transform2D_)));
+    theEngine().bindTexture(2, heightfield_texture_);
+  }
+  theEngine().bindTexture(1, emitter_texture_, GL_TEXTURE_BUFFER);
+
+  // Read the last count before reusing its query. Drawing the live particles below may need it too.
+  liveCount();
+  bool counting = !draw_feedback_ || instanced_;
+  glEnable(GL_RASTERIZER_DISCARD);
+  if (draw_feedback_) {
+    glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, transform_feedbacks_[current_dest_]);
+  } else {
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer_objects_[current_dest_]);
+  }
+  if (counting) glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, count_query_);
+  glBeginTransformFeedback(GL_POINTS);
+  if (simulated_) {
+    glUniform1i(theEngine().uniformHandle("spawning"), 0);
+    drawLive();
+  }
+  glUniform1i(theEngine().uniformHandle("spawning"), 1);
+  glBindVertexArray(array_objects_[current_source_]);
+  glDrawArrays(GL_POINTS, 0, emitters_.size());
+  glEndTransformFeedback();
+  if (draw_feedback_) glBindTransformFeedback(GL_TRANSFORM_FEEDBACK, 0);
+  if (counting) glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+  counted_ = counting;
+  count_pending_ = counting;
+  glDisable(GL_RASTERIZER_DISCARD);
+}
+
+// Invalidating the buffer lets GL hand us fresh memory rather than wait on draws still reading it.
+void ParticleSystem::updateCpu(float delta_time) {
+  ParticleStep step;
+  step.delta_time = delta_time;
+  step.alpha_decay = kParticleAlphaDecay;
+  step.lifetime = kParticleLifetime;
+  step.spawn_speed = kParticleSpawnSpeed;
+  step.seed = seed_++;
+  step.gravity = gravity_;
+  step.drag = drag_;
+  step.projection = projection_;
+  step.inverse_projection = inverse_projection_;
+  step.container_circles = &container_circles_;
+  step.collision_radius = collision_radius_;
+  step.heights = use_heightfield_ ? &heights_ : NULL;
+  step.heightfield_range = heightfield_range_;
+  step.transform2D = transform2D_;
+  step.inverse_transform2D = glm::inverse(transform2D_);
+  step.emitters = &emitters_;
+  cpu_particles_->update(step);
+
+  live_count_ = cpu_particles_->size();
+  counted_ = true;
+  count_pending_ = false;
+  if (live_count_ == 0) return;
+  glBindBuffer(GL_ARRAY_BUFFER, buffer_objects_[current_dest_]);
+  Particle *particles = static_cast<Particle *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(Particle) * live_count_,
+    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+  if (particles == NULL) error("Could not map the particle buffer.\n");
+  cpu_particles_->pack(particles);
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+
+// Particles are packed in whatever order they were spawned, so emitters no longer draw back to front.
+// Billboards wait for an update that counted, in case they were only just turned on.
 void ParticleSystem::draw() {
-  sortDepthIndex();
-  theEngine().useProgram("particle_draw");
+  if (!simulated_) return;
+  if (weighted_transparency_) {
+    drawTransparent();
+  } else {
+    drawParticles(0);
+  }
+}
+
+void ParticleSystem::drawParticles(unsigned int flags) {
+  bool instanced = instanced_ && counted_;
+  theEngine().useProgram(instanced ? "particle_billboard" : "particle_draw", flags);
   glUniformMatrix4fv(theEngine().uniformHandle("transform3D"), 1, GL_FALSE, 
     glm::value_ptr(projection_ * transform3D_));
   glUniformMatrix3fv(theEngine().uniformHandle("transform2D"), 1, GL_FALSE, 
     glm::value_ptr(theEngine().rootEntity()->fullTransform() * transform2D_));
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture_handle_);
-  for (vector<int>::iterator it = emitters_by_depth_.begin(); it != emitters_by_depth_.end(); ++it) {
-    emitters_[*it].drawArray();
+  theEngine().bindTexture(0, texture_handle_);
+  theEngine().bindTexture(1, emitter_texture_, GL_TEXTURE_BUFFER);
+  if (instanced) {
+    drawBillboards();
+  } else {
+    drawLive();
   }
 }
 
-struct DepthSortFunctor {
-  bool operator() (const int left, const int right) {
-    return emitters->at(left).position().z < emitters->at(right).position().z;
+void ParticleSystem::allocateTransparencyTargets(int width, int height) {
+  if (transparency_frame_buffer_ != 0 && transparency_size_ == glm::ivec2(width, height)) return;
+  if (transparency_frame_buffer_ == 0) {
+    glGenFramebuffers(1, &transparency_frame_buffer_);
+    glGenTextures(2, transparency_textures_);
   }
-  vector<Emitter> *emitters;
-};
+  transparency_size_ = glm::ivec2(width, height);
+  // Weights run into the thousands, so both need floats.
+  GLenum formats[] = {GL_RGBA16F, GL_R16F};
+  glBindFramebuffer(GL_FRAMEBUFFER, transparency_frame_buffer_);
+  for (int i = 0; i < 2; ++i) {
+    theEngine().bindTexture(0, transparency_textures_[i]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, formats[i], width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, transparency_textures_[i], 0);
+  }
+  GLenum draw_buffers[] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, draw_buffers);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    error("Particle transparency framebuffer not complete. Something went wrong :(\n");
+  }
+}
+
+// GL 3.3 has one blend function for every draw buffer. Adding works for both color and weights, and
+// the alpha factors multiply revealage by one minus each alpha. The weight target has no alpha, so its
+// alpha factors do nothing.
+void ParticleSystem::drawTransparent() {
+  GLint frame_buffer, viewport[4];
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &frame_buffer);
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  GLboolean blend = glIsEnabled(GL_BLEND), alpha_to_coverage = glIsEnabled(GL_SAMPLE_ALPHA_TO_COVERAGE);
+  allocateTransparencyTargets(viewport[2], viewport[3]);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, transparency_frame_buffer_);
+  glViewport(0, 0, viewport[2], viewport[3]);
+  GLfloat clear_accumulation[] = {0.0f, 0.0f, 0.0f, 1.0f}, clear_weight[] = {0.0f, 0.0f, 0.0f, 0.0f};
+  glClearBufferfv(GL_COLOR, 0, clear_accumulation);
+  glClearBufferfv(GL_COLOR, 1, clear_weight);
+  glEnable(GL_BLEND);
+  glDisable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+  glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+  drawParticles(WEIGHTED_OIT);
 
-void ParticleSystem::sortDepthIndex() {
-  DepthSortFunctor functor;
-  functor.emitters = &emitters_;
-  std::sort(emitters_by_depth_.begin(), emitters_by_depth_.end(), functor);
+  glBindFramebuffer(GL_FRAMEBUFFER, frame_buffer);
+  glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  theEngine().useProgram("particle_composite");
+  theEngine().bindTexture(0, transparency_textures_[0]);
+  theEngine().bindTexture(1, transparency_textures_[1]);
+  glm::mat3 screen_transform = glm::mat3(1.0f);
+  screen_transform = translate2D(screen_transform, glm::vec2(-1.0));
+  screen_transform = scale2D(screen_transform, glm::vec2(2.0));
+  glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(screen_transform));
+  theEngine().drawUnitQuad();
+  if (!blend) glDisable(GL_BLEND);
+  if (alpha_to_coverage) glEnable(GL_SAMPLE_ALPHA_TO_COVERAGE);
 }
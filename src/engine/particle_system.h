@@ -1,6 +1,7 @@
 #ifndef SRC_PARTICLE_SYSTEM_H_
 #define SRC_PARTICLE_SYSTEM_H_
 
+#include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <list>
 
@@ -9,44 +10,102 @@
 
 using std::list;
 
+class CpuParticles;
+
 struct Particle {
   glm::vec3 position, velocity;
   glm::vec4 color;
   float age, visible;
+  GLint emitter;
 };
 
+// Where new particles spawn and what they look like. Particles live in the system's buffers, the emitter
+// is just the parameters.
 class Emitter {
   public:
     Emitter();
     ~Emitter();
-    void init(int num_particles);
     bool visible() { return visible_; }
     void setVisible(bool visible) { visible_ = visible; }
     glm::vec3 position() { return position_; }
     void setPosition(glm::vec3 position) { position_ = position; }
     glm::vec4 color() { return color_; }
     void setColor(glm::vec4 color) { color_ = color; }
-    void update(float delta_time);
-    // Binds current VAO and draws it. Uniforms set by particle system before hand.
-    void drawArray();
+    // Particles spawned per second while visible.
+    float rate() { return rate_; }
+    void setRate(float rate) { rate_ = rate; }
+    // Higher priority emitters keep more of their particles when the budget is tight. One by default.
+    float priority() { return priority_; }
+    void setPriority(float priority) { priority_ = priority; }
+    // Fraction of its rate the particle budget lets the emitter spawn, one until a budget is set.
+    void setBudgetFraction(float fraction) { budget_fraction_ = fraction; }
+    float budgetedRate() { return rate_ * budget_fraction_; }
+    // Fewer particles are drawn bigger, so the emitter covers about as much of the screen.
+    float sizeScale();
   private:
     bool visible_;
     glm::vec3 position_;
     glm::vec4 color_;
-    int num_particles_, current_source_, current_dest_;
-    GLuint array_objects_[2], buffer_objects_[2];
-    //GLuint transform_feedbacks_[2];
+    float rate_, priority_, budget_fraction_;
 };
 
+// Where particles are simulated. Either way they are drawn from GL buffers the same way.
+enum ParticleBackend {
+  // Transform feedback, particles never leave the GPU.
+  GPU_PARTICLES,
+  // SSE over a thread pool, streaming particles up every update. See CpuParticles.
+  CPU_PARTICLES
+};
+
+// Every emitter's particles share one pair of buffers, so the whole system updates with one transform
+// feedback pass and draws with one call. The pass drops dead particles and appends the ones emitters
+// spawned, so buffers hold just the live particles, packed at the front, and only those are simulated
+// and drawn. Emitter parameters go to the GPU as a texture buffer looked up by emitter index.
 class ParticleSystem : public Drawable {
   public:
+    static const int kMaxContainerCircles = 16;
+    static const int kParticlesPerEmitter = 300;
     ParticleSystem();
     ~ParticleSystem();
-    // Set up the VAOs and VBOs and what not.
-    void init(int num_emitters);
+    // Set up the VAOs and VBOs and what not. Room for kParticlesPerEmitter per emitter unless a capacity
+    // is given. Particles spawned past capacity are dropped.
+    void init(int num_emitters, int capacity = 0, ParticleBackend backend = GPU_PARTICLES);
     void setEmitterPosition(int index, glm::vec3 position) { emitters_[index].setPosition(position); }
     void setEmitterColor(int index, glm::vec4 color) { emitters_[index].setColor(color); }
     void setEmitterVisible(int index, bool visible) { emitters_[index].setVisible(visible); }
+    void setEmitterRate(int index, float rate) { emitters_[index].setRate(rate); }
+    void setEmitterPriority(int index, float priority) { emitters_[index].setPriority(priority); }
+    // =====Budget=====
+    // Called by the particle budget. Demand is how many particles the visible, on screen emitters would
+    // keep alive at their full rates. The budget is how many the system gets. It's split between emitters
+    // by priority and screen size, no emitter getting more than it wants, and their rates scaled to fit.
+    float budgetDemand();
+    void setBudget(float particles);
+    // =====Simulation=====
+    // Both act on every particle, in particle space. None of either by default.
+    void setGravity(glm::vec3 gravity) { gravity_ = gravity; }
+    void setDrag(float drag) { drag_ = drag; }
+    // Particles are kept inside the union of these circles, centers and radii in the projected 2D space
+    // particles are drawn in before transform2D. At most kMaxContainerCircles. Empty turns it off.
+    void setContainerCircles(const vector<glm::vec3> &circles);
+    void setCollisionRadius(float radius) { collision_radius_ = radius; }
+    // Ground heights evenly spaced from min_x to max_x, in the space transform2D takes particles to.
+    // Particles that fall below it are lifted back on top.
+    void setHeightfield(const vector<float> &heights, float min_x, float max_x);
+    void clearHeightfield() { use_heightfield_ = false; }
+    // =====Drawing=====
+    // Draws billboards as instances of one quad rather than expanding points in a geometry shader. Needs
+    // the live count on the CPU, so updates read it back with a query.
+    bool instancedBillboards() { return instanced_; }
+    void setInstancedBillboards(bool instanced) { instanced_ = instanced; }
+    // How many particles are alive. Reads back from GL, waiting on the last update if needed. Zero unless
+    // the last update was counted, see instancedBillboards. CPU updates always count.
+    GLuint liveCount();
+    // Blends particles with weighted blended order independent transparency, since they aren't sorted.
+    // Draws into offscreen accumulation targets the size of the viewport, then composites those over
+    // whatever was bound. Off by default.
+    bool weightedTransparency() { return weighted_transparency_; }
+    void setWeightedTransparency(bool weighted) { weighted_transparency_ = weighted; }
     void update(float delta_time);
     void draw();
     glm::mat4 transform3D() { return transform3D_; }
@@ -57,13 +116,52 @@ class ParticleSystem : public Drawable {
     glm::mat4 inverseProjection() { return inverse_projection_; }
 
   private:
-    void sortDepthIndex();
+    // How big the emitter's particles are on screen, zero if it's hidden or off screen.
+    float screenWeight(int index);
+    void uploadEmitters();
+    void updateFeedback(float delta_time);
+    void updateCpu(float delta_time);
+    // Draws the live particles in the current source buffer.
+    void drawLive();
+    void drawBillboards();
+    void drawParticles(unsigned int flags);
+    // Makes or resizes the accumulation targets.
+    void allocateTransparencyTargets(int width, int height);
+    void drawTransparent();
     vector<Emitter> emitters_;
-    vector<int> emitters_by_depth_;
     glm::mat4 projection_, inverse_projection_, transform3D_;
     glm::mat3 transform2D_;
+    int capacity_, current_source_, current_dest_;
+    // Nothing to draw until the first update has run.
+    bool simulated_;
+    bool instanced_, weighted_transparency_;
+    // Whether GL can draw straight from what feedback wrote. Otherwise we count with a query and draw that
+    // many. The count is read back lazily, so the update has a chance to finish first.
+    bool draw_feedback_;
+    bool counted_, count_pending_;
+    GLuint live_count_;
+    glm::vec3 gravity_;
+    float drag_, collision_radius_;
+    vector<glm::vec3> container_circles_;
+    bool use_heightfield_;
+    // Kept for the CPU backend, the feedback shader reads the texture.
+    vector<float> heights_;
+    glm::vec2 heightfield_range_;
+    // Changed every update, seeds the shader's random respawns.
+    unsigned int seed_;
+    // Only with the CPU backend.
+    CpuParticles *cpu_particles_;
     // GL stuff
     GLuint texture_handle_;
+    GLuint array_objects_[2], buffer_objects_[2];
+    // Same buffers as per instance attributes, over a quad's corners.
+    GLuint billboard_arrays_[2], corner_buffer_;
+    GLuint transform_feedbacks_[2], count_query_;
+    GLuint emitter_buffer_, emitter_texture_;
+    GLuint heightfield_texture_;
+    // Accumulated color with revealage in alpha, and summed weights.
+    GLuint transparency_frame_buffer_, transparency_textures_[2];
+    glm::ivec2 transparency_size_;
 };
 
 #endif  // SRC_PARTICLE_SYSTEM_H_
@@ -4,6 +4,8 @@
 #include <glm/glm.hpp>
 
 #include "engine/entity.h"
+#include "engine/fill.h"
+#include "engine/quad_batch.h"
 
 class Quad : public Entity {
   public:
@@ -12,9 +14,21 @@ class Quad : public Entity {
     void init() {}
     void extent(glm::vec2 *min, glm::vec2 *max) { *min = min_; *max = max_; }
     void setExtent(glm::vec2 min, glm::vec2 max) { min_ = min; max_ = max; }
-    void draw() { fill()->fillIn(this); }
-    void drawOccluder() { fill()->fillInOccluder(this); }
+    void draw() { drawHelper(false); }
+    void drawOccluder() { drawHelper(true); }
+    // Quads all draw with the batch's program, so only shadowing and the texture split them.
+    uint64_t drawKey(bool asOccluder) {
+      QuadStyle style;
+      fill()->quadStyle(this, asOccluder, &style);
+      return makeDrawKey(0, style.shadowed ? 1 : 0, style.texture, 0);
+    }
+    bool batchesDraws() { return true; }
   private:
+    void drawHelper(bool asOccluder) {
+      QuadStyle style;
+      fill()->quadStyle(this, asOccluder, &style);
+      theQuadBatch().add(this, style);
+    }
     glm::vec2 min_, max_;
 };
 
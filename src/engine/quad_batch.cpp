@@ -0,0 +1,86 @@
+#include "engine/quad_batch.h"
+
+#include <cstddef>
+
+#include "engine/engine.h"
+
+QuadBatch &theQuadBatch() {
+  // Never deleted, the GL context is gone by the time statics are destroyed anyway.
+  static QuadBatch *quad_batch = new QuadBatch();
+  return *quad_batch;
+}
+
+QuadBatch::QuadBatch()
+  : capacity_(0),
+    array_object_(0),
+    buffer_object_(0) {}
+
+QuadBatch::~QuadBatch() {}
+
+void QuadBatch::init() {
+  glGenVertexArrays(1, &array_object_);
+  glGenBuffers(1, &buffer_object_);
+  glBindVertexArray(array_object_);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer_object_);
+  GLuint handle = theEngine().attributeHandle("position");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, sizeof(QuadVertex), (void *)offsetof(QuadVertex, position));
+  handle = theEngine().attributeHandle("tex_coord");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, sizeof(QuadVertex), (void *)offsetof(QuadVertex, tex_coord));
+  handle = theEngine().attributeHandle("color");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribPointer(handle, 4, GL_FLOAT, GL_FALSE, sizeof(QuadVertex), (void *)offsetof(QuadVertex, color_mul));
+  handle = theEngine().attributeHandle("color_add");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribPointer(handle, 4, GL_FLOAT, GL_FALSE, sizeof(QuadVertex), (void *)offsetof(QuadVertex, color_add));
+  glBindVertexArray(0);
+}
+
+void QuadBatch::add(Entity *entity, const QuadStyle &style) {
+  // Untextured quads don't care what's bound, so they join whatever run is going.
+  if (runs_.empty() || runs_.back().shadowed != style.shadowed ||
+      (style.texture != 0 && runs_.back().texture != style.texture)) {
+    if (!runs_.empty() && runs_.back().texture == 0 && runs_.back().shadowed == style.shadowed) {
+      runs_.back().texture = style.texture;
+    } else {
+      Run run = {style.texture, style.shadowed, vertices_.size(), 0};
+      runs_.push_back(run);
+    }
+  }
+
+  glm::vec2 min, max;
+  entity->extent(&min, &max);
+  glm::mat3 transform = entity->fullTransform();
+  // Two triangles, same corners as the unit quad's fan.
+  static const glm::vec2 kCorners[6] = {glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(1.0f, 1.0f),
+    glm::vec2(0.0f, 0.0f), glm::vec2(1.0f, 1.0f), glm::vec2(0.0f, 1.0f)};
+  for (int i = 0; i < 6; ++i) {
+    QuadVertex vertex;
+    vertex.position = glm::vec2(transform * glm::vec3(min + kCorners[i] * (max - min), 1.0f));
+    vertex.tex_coord = kCorners[i] * style.tex_scale;
+    vertex.color_mul = style.color_mul;
+    vertex.color_add = style.color_add;
+    vertices_.push_back(vertex);
+  }
+  runs_.back().count += 6;
+}
+
+void QuadBatch::flush() {
+  if (vertices_.empty()) return;
+  if (array_object_ == 0) init();
+  // Orphan last flush's storage so we never wait on a draw still reading it.
+  glBindBuffer(GL_ARRAY_BUFFER, buffer_object_);
+  if (vertices_.size() > capacity_) capacity_ = vertices_.size() * 2;
+  glBufferData(GL_ARRAY_BUFFER, capacity_ * sizeof(QuadVertex), NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, vertices_.size() * sizeof(QuadVertex), &vertices_[0]);
+
+  glBindVertexArray(array_object_);
+  for (vector<Run>::iterator it = runs_.begin(); it != runs_.end(); ++it) {
+    theEngine().useProgram("quad_batch", it->shadowed ? SHADOWED : 0);
+    theEngine().bindTexture(0, it->texture);
+    glDrawArrays(GL_TRIANGLES, it->first, it->count);
+  }
+  vertices_.clear();
+  runs_.clear();
+}
@@ -0,0 +1,54 @@
+#ifndef SRC_QUAD_BATCH_H_
+#define SRC_QUAD_BATCH_H_
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "engine/entity.h"
+
+using std::vector;
+
+// How a fill wants its quad drawn. Colored fills leave the texture at zero and the multiplier at zero, so
+// only the addition shows.
+struct QuadStyle {
+  GLuint texture;
+  bool shadowed;
+  glm::vec2 tex_scale;
+  glm::vec4 color_mul, color_add;
+};
+
+class QuadBatch;
+
+QuadBatch &theQuadBatch();
+
+// Collects quads as they are drawn into one streamed vertex buffer, corners already transformed to the
+// screen. Flushing draws them with one call per run of the same texture and shadowing. The draw loop
+// flushes before anything that isn't a quad, so quads still land in draw order.
+class QuadBatch {
+  public:
+    QuadBatch();
+    ~QuadBatch();
+    void add(Entity *entity, const QuadStyle &style);
+    void flush();
+
+  private:
+    struct QuadVertex {
+      glm::vec2 position;
+      glm::vec2 tex_coord;
+      glm::vec4 color_mul, color_add;
+    };
+    struct Run {
+      GLuint texture;
+      bool shadowed;
+      size_t first, count;
+    };
+    void init();
+    // Member data.
+    vector<QuadVertex> vertices_;
+    vector<Run> runs_;
+    size_t capacity_;
+    GLuint array_object_, buffer_object_;
+};
+
+#endif  // SRC_QUAD_BATCH_H_
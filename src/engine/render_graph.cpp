@@ -0,0 +1,210 @@
+#include "engine/render_graph.h"
+
+#include <cstdio>
+
+#include "engine/engine.h"
+#include "util/error.h"
+
+RenderGraph::RenderGraph()
+  : width_(0),
+    height_(0),
+    frame_(0) {
+  Target backbuffer;
+  backbuffer.name = "backbuffer";
+  backbuffer.allocation = -1;
+  targets_.push_back(backbuffer);
+}
+
+RenderGraph::~RenderGraph() {
+  release();
+  for (vector<Pass>::iterator it = passes_.begin(); it != passes_.end(); ++it) {
+    delete it->pass;
+  }
+}
+
+int RenderGraph::addTarget(string name, const RenderTargetDesc &desc) {
+  Target target;
+  target.name = name;
+  target.desc = desc;
+  target.allocation = -1;
+  targets_.push_back(target);
+  return targets_.size() - 1;
+}
+
+int RenderGraph::addPass(string name, RenderPass *pass, int output) {
+  Pass new_pass;
+  new_pass.name = name;
+  new_pass.pass = pass;
+  new_pass.output = output;
+  new_pass.culled = false;
+  new_pass.frame_buffer = 0;
+  new_pass.queries[0] = new_pass.queries[1] = 0;
+  new_pass.queried[0] = new_pass.queried[1] = false;
+  new_pass.milliseconds = 0.0;
+  new_pass.timed_frames = 0;
+  passes_.push_back(new_pass);
+  return passes_.size() - 1;
+}
+
+void RenderGraph::read(int pass, int target) {
+  passes_[pass].inputs.push_back(target);
+}
+
+void RenderGraph::compile(int width, int height) {
+  release();
+  width_ = width;
+  height_ = height;
+  cull();
+  allocate();
+}
+
+// Walks back from the backbuffer. A pass is run only if something run after it reads what it writes.
+void RenderGraph::cull() {
+  vector<bool> wanted(targets_.size(), false);
+  wanted[kBackbuffer] = true;
+  for (int i = passes_.size() - 1; i >= 0; --i) {
+    Pass &pass = passes_[i];
+    pass.culled = !wanted[pass.output];
+    if (pass.culled) continue;
+    for (vector<int>::iterator it = pass.inputs.begin(); it != pass.inputs.end(); ++it) {
+      wanted[*it] = true;
+    }
+  }
+}
+
+static bool sameDesc(const RenderTargetDesc &left, const RenderTargetDesc &right) {
+  return left.scale == right.scale && left.format == right.format && left.filter == right.filter &&
+    left.depth_stencil == right.depth_stencil;
+}
+
+// Finds each target's lifetime, then hands out textures in order of first use. A target takes over a
+// matching texture whose last user ran before it starts.
+void RenderGraph::allocate() {
+  for (vector<Target>::iterator it = targets_.begin(); it != targets_.end(); ++it) {
+    it->first_use = -1;
+    it->last_use = -1;
+    it->allocation = -1;
+  }
+  for (size_t i = 0; i < passes_.size(); ++i) {
+    if (passes_[i].culled) continue;
+    Target &output = targets_[passes_[i].output];
+    if (output.first_use < 0) output.first_use = i;
+    output.last_use = i;
+    for (vector<int>::iterator it = passes_[i].inputs.begin(); it != passes_[i].inputs.end(); ++it) {
+      targets_[*it].last_use = i;
+    }
+  }
+
+  for (size_t i = 0; i < passes_.size(); ++i) {
+    Pass &pass = passes_[i];
+    if (pass.culled) continue;
+    glGenQueries(2, pass.queries);
+    if (pass.output == kBackbuffer) continue;
+    Target &target = targets_[pass.output];
+    if (target.allocation < 0) {
+      for (size_t j = 0; j < allocations_.size(); ++j) {
+        if (allocations_[j].last_use < target.first_use && sameDesc(allocations_[j].desc, target.desc)) {
+          target.allocation = j;
+          break;
+        }
+      }
+    }
+    if (target.allocation < 0) {
+      Allocation allocation;
+      allocation.desc = target.desc;
+      int width = static_cast<int>(width_ * target.desc.scale), height = static_cast<int>(height_ * target.desc.scale);
+      glGenTextures(1, &allocation.texture);
+      theEngine().bindTexture(0, allocation.texture);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, target.desc.filter);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, target.desc.filter);
+      glTexImage2D(GL_TEXTURE_2D, 0, target.desc.format, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+      allocation.depth_stencil = 0;
+      if (target.desc.depth_stencil) {
+        // Stencil only formats aren't supported on any hardware, so we get depth with it.
+        glGenRenderbuffers(1, &allocation.depth_stencil);
+        glBindRenderbuffer(GL_RENDERBUFFER, allocation.depth_stencil);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+      }
+      allocations_.push_back(allocation);
+      target.allocation = allocations_.size() - 1;
+    }
+    allocations_[target.allocation].last_use = target.last_use;
+
+    Allocation &allocation = allocations_[target.allocation];
+    glGenFramebuffers(1, &pass.frame_buffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, pass.frame_buffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, allocation.texture, 0);
+    if (allocation.depth_stencil != 0) {
+      glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, allocation.depth_stencil);
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+      error("Framebuffer for pass %s not complete. Something went wrong :(\n", pass.name.c_str());
+    }
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void RenderGraph::release() {
+  for (vector<Pass>::iterator it = passes_.begin(); it != passes_.end(); ++it) {
+    if (it->frame_buffer != 0) glDeleteFramebuffers(1, &it->frame_buffer);
+    if (it->queries[0] != 0) glDeleteQueries(2, it->queries);
+    it->frame_buffer = 0;
+    it->queries[0] = it->queries[1] = 0;
+    it->queried[0] = it->queried[1] = false;
+  }
+  for (vector<Allocation>::iterator it = allocations_.begin(); it != allocations_.end(); ++it) {
+    glDeleteTextures(1, &it->texture);
+    if (it->depth_stencil != 0) glDeleteRenderbuffers(1, &it->depth_stencil);
+  }
+  if (!allocations_.empty()) theEngine().forgetTextures();
+  allocations_.clear();
+}
+
+void RenderGraph::execute() {
+  int query = frame_ % 2;
+  for (vector<Pass>::iterator it = passes_.begin(); it != passes_.end(); ++it) {
+    if (it->culled) continue;
+    // This query was last used two frames back, so its time should be ready by now.
+    if (it->queried[query]) readTime(&*it, query);
+    glBindFramebuffer(GL_FRAMEBUFFER, it->frame_buffer);
+    if (it->output == kBackbuffer) {
+      glViewport(0, 0, width_, height_);
+    } else {
+      float scale = targets_[it->output].desc.scale;
+      glViewport(0, 0, static_cast<int>(width_ * scale), static_cast<int>(height_ * scale));
+    }
+    glBeginQuery(GL_TIME_ELAPSED, it->queries[query]);
+    it->pass->execute(this);
+    glEndQuery(GL_TIME_ELAPSED);
+    it->queried[query] = true;
+  }
+  ++frame_;
+}
+
+GLuint RenderGraph::texture(int target) {
+  int allocation = targets_[target].allocation;
+  if (allocation < 0) error("Render target %s has no texture.\n", targets_[target].name.c_str());
+  return allocations_[allocation].texture;
+}
+
+void RenderGraph::readTime(Pass *pass, int query) {
+  GLuint64 nanoseconds;
+  glGetQueryObjectui64v(pass->queries[query], GL_QUERY_RESULT, &nanoseconds);
+  pass->milliseconds += nanoseconds / 1000000.0;
+  ++pass->timed_frames;
+  pass->queried[query] = false;
+}
+
+void RenderGraph::printTimes() {
+  for (vector<Pass>::iterator it = passes_.begin(); it != passes_.end(); ++it) {
+    if (it->culled) {
+      printf("Pass %s: culled.\n", it->name.c_str());
+    } else if (it->timed_frames > 0) {
+      printf("Pass %s: %f ms.\n", it->name.c_str(), it->milliseconds / it->timed_frames);
+    }
+    it->milliseconds = 0.0;
+    it->timed_frames = 0;
+  }
+}
@@ -0,0 +1,101 @@
+#ifndef SRC_RENDER_GRAPH_H_
+#define SRC_RENDER_GRAPH_H_
+
+#include <GL/glew.h>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+// A render target passes write and read. The size is a fraction of the window's.
+struct RenderTargetDesc {
+  float scale;
+  GLenum format;
+  GLenum filter;
+  bool depth_stencil;
+};
+
+class RenderGraph;
+
+// Something for the graph to run. Its output is already bound, with the viewport set to match.
+class RenderPass {
+  public:
+    virtual ~RenderPass() {}
+    virtual void execute(RenderGraph *graph) = 0;
+};
+
+// Runs a member function as a pass.
+template <class T>
+class MethodPass : public RenderPass {
+  public:
+    MethodPass(T *object, void (T::*method)(RenderGraph *)) : object_(object), method_(method) {}
+    void execute(RenderGraph *graph) { (object_->*method_)(graph); }
+  private:
+    T *object_;
+    void (T::*method_)(RenderGraph *);
+};
+
+// Passes declare the targets they read and the one they write, and run in the order they were added.
+// Compiling culls passes nobody reads from and gives each remaining target a texture. Targets alive at
+// different times share one if they match. Every pass is timed on the GPU.
+class RenderGraph {
+  public:
+    // The window's framebuffer. Always there, and whatever writes it is always run.
+    static const int kBackbuffer = 0;
+    RenderGraph();
+    ~RenderGraph();
+    int addTarget(string name, const RenderTargetDesc &desc);
+    // The graph owns the pass.
+    int addPass(string name, RenderPass *pass, int output);
+    void read(int pass, int target);
+    // Culls and allocates for a window size. Call again if the passes or the size change.
+    void compile(int width, int height);
+    void execute();
+    // The texture a target ended up with, for passes binding their inputs.
+    GLuint texture(int target);
+    bool culled(int pass) { return passes_[pass].culled; }
+    // Prints the average GPU time of each pass since the last print.
+    void printTimes();
+
+  private:
+    struct Target {
+      string name;
+      RenderTargetDesc desc;
+      // First and last pass using the target, and the texture it was given.
+      int first_use, last_use;
+      int allocation;
+    };
+    struct Pass {
+      string name;
+      RenderPass *pass;
+      int output;
+      vector<int> inputs;
+      bool culled;
+      GLuint frame_buffer;
+      // Alternate between two queries so reading one never waits on the frame in flight.
+      GLuint queries[2];
+      bool queried[2];
+      double milliseconds;
+      int timed_frames;
+    };
+    struct Allocation {
+      RenderTargetDesc desc;
+      GLuint texture, depth_stencil;
+      // Last pass using the allocation so far.
+      int last_use;
+    };
+    // Helpers.
+    void cull();
+    void allocate();
+    void release();
+    void readTime(Pass *pass, int query);
+    // Member data.
+    int width_, height_;
+    int frame_;
+    vector<Target> targets_;
+    vector<Pass> passes_;
+    vector<Allocation> allocations_;
+};
+
+#endif  // SRC_RENDER_GRAPH_H_
@@ -11,13 +11,25 @@ Shader::~Shader() {
   if (handle_ != 0) glDeleteShader(handle_);
 }
 
-void Shader::load(string filename, GLenum type) {
+static const char *kShaderFlagNames[kNumShaderFlags] = {"ANIMATED", "SHADOWED", "PATH", "BATCHED", "WEIGHTED_OIT"};
+
+void Shader::load(string filename, GLenum type, unsigned int flags) {
   filename_ = filename;
   // Read the file into a buffer.
   char *source = readFileToCString(filename);
+  // Defines have to come after the version, so split the source after its first line.
+  string defines;
+  for (int i = 0; i < kNumShaderFlags; ++i) {
+    if (flags & (1 << i)) defines += string("#define ") + kShaderFlagNames[i] + "\n";
+  }
+  string full_source(source);
+  size_t version_end = full_source.find('\n', full_source.find("#version"));
+  if (version_end == string::npos) error("Shader %s has no #version line.\n", filename_.c_str());
+  string version = full_source.substr(0, version_end + 1), body = full_source.substr(version_end + 1);
+  const GLchar *sources[3] = {version.c_str(), defines.c_str(), body.c_str()};
   // Set up and compile shader.
   handle_ = glCreateShader(type);
-  glShaderSource(handle_, 1, const_cast<const GLchar **>(&source), NULL);
+  glShaderSource(handle_, 3, sources, NULL);
   glCompileShader(handle_);
   // Check compile.
   GLint compiled;
@@ -10,11 +10,27 @@ using std::string;
 using std::vector;
 using std::map;
 
+// Feature flags for shader variants. A program asked for with some flags set has each of them #defined in
+// all its shaders, right after the #version line.
+enum ShaderFlag {
+  // Blends positions between three keyframes.
+  ANIMATED = 1 << 0,
+  // Darkened by the god rays exposure texture.
+  SHADOWED = 1 << 1,
+  // Drawn from path triangles, with curve edges anti-aliased in the shader.
+  PATH = 1 << 2,
+  // Fill parameters come per vertex from a batch rather than from uniforms.
+  BATCHED = 1 << 3,
+  // Writes weighted blended transparency targets instead of a color.
+  WEIGHTED_OIT = 1 << 4
+};
+static const int kNumShaderFlags = 5;
+
 class Shader {
   public:
     Shader();
     ~Shader();
-    void load(string filename, GLenum type);
+    void load(string filename, GLenum type, unsigned int flags = 0);
     GLuint handle() { return handle_; }
 
   private:
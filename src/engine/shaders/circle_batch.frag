@@ -0,0 +1,25 @@
+#version 330
+
+in vec2 frag_offset;
+in vec4 frag_color;
+
+out vec4 out_color;
+
+void main()
+{
+  float x = frag_offset.x;
+  float y = frag_offset.y;
+  vec2 dx = dFdx(frag_offset);
+  vec2 dy = dFdy(frag_offset);
+
+  // Chain rule
+  float fx = 2*x*dx.x + 2*y*dx.y;
+  float fy = 2*x*dy.x + 2*y*dy.y;
+  // Signed distance
+  float sd = (x*x + y*y - 1.0)/sqrt(fx*fx + fy*fy);
+  // Linear alpha
+  float alpha = clamp(0.5 - sd, 0.0, 1.0);
+  if (alpha <= 0.0) discard;
+  out_color = frag_color;
+  out_color.a *= alpha;
+}
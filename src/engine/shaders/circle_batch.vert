@@ -0,0 +1,26 @@
+#version 330
+
+uniform mat3 modelview;
+// Occluders are drawn in one flat color.
+uniform bool occluder = false;
+uniform vec4 occluder_color = vec4(0.0, 0.0, 0.0, 1.0);
+
+// Corner of the unit quad.
+in vec2 position;
+// Per instance.
+in vec2 instance_center;
+in float instance_radius;
+in vec4 color;
+
+// Where we are in the circle's square, -1 to 1 on both axes.
+out vec2 frag_offset;
+out vec4 frag_color;
+
+void main()
+{
+  frag_offset = 2.0 * position - vec2(1.0);
+  frag_color = occluder ? occluder_color : color;
+  vec2 circle_pos = instance_center + frag_offset * instance_radius;
+  vec2 screen_pos = (modelview * vec3(circle_pos, 1.0)).xy;
+  gl_Position = vec4(screen_pos, 0.0, 1.0);
+}
@@ -2,7 +2,7 @@
 
 uniform sampler2D color_texture;
 
-in vec2 frag_bezier_coord;
+in vec3 frag_bezier_coord;
 in vec2 frag_tex_coord;
 
 out vec4 out_color;
@@ -13,8 +13,8 @@ void main()
   float x = frag_bezier_coord.x;
   float y = frag_bezier_coord.y;
 
-  vec2 dx = dFdx(frag_bezier_coord);
-  vec2 dy = dFdy(frag_bezier_coord);
+  vec2 dx = dFdx(frag_bezier_coord.xy);
+  vec2 dy = dFdy(frag_bezier_coord.xy);
   // Chain rule
   float fx = 2*x*dx.x + 2*y*dx.y;
   float fy = 2*x*dy.x + 2*y*dy.y;
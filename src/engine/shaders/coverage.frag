@@ -0,0 +1,48 @@
+#version 330
+
+// Feature flags, defined by the engine right after the version line.
+//   PATH: drawn from path triangles, so curve triangles only cover what's inside their curve.
+
+#ifdef PATH
+// Matches PathVertexType in shape.h.
+const int ON_PATH = 1;
+const int QUADRIC = 2;
+const int CUBIC = 3;
+
+in vec3 frag_bezier_coord;
+flat in int frag_segment_type;
+#endif
+
+// How much of the fragment is covered, as an alpha. Zero outside.
+float coverage()
+{
+#ifdef PATH
+  // Solid triangles are always inside.
+  if (frag_segment_type == ON_PATH) return 1.0;
+
+  float x = frag_bezier_coord.x;
+  float y = frag_bezier_coord.y;
+  float z = frag_bezier_coord.z;
+  vec3 dx = dFdx(frag_bezier_coord);
+  vec3 dy = dFdy(frag_bezier_coord);
+
+  // Implicit function and chain rule for its screen gradient.
+  float f, fx, fy;
+  if (frag_segment_type == QUADRIC) {
+    f = x*x - y;
+    fx = 2*x*dx.x - dx.y;
+    fy = 2*x*dy.x - dy.y;
+  } else {
+    f = x*x*x - y*z;
+    fx = 3*x*x*dx.x - y*dx.z - z*dx.y;
+    fy = 3*x*x*dy.x - y*dy.z - z*dy.y;
+  }
+  // Signed distance
+  float sd = f/sqrt(fx*fx + fy*fy);
+  // Linear alpha
+  return clamp(0.5 - sd, 0.0, 1.0);
+#else
+  // Quads are masked by the stencil, so they cover every fragment.
+  return 1.0;
+#endif
+}
@@ -1,20 +1,53 @@
 #version 330
 
+// Feature flags, defined by the engine right after the version line.
+//   ANIMATED: blends positions and bezier coords between three keyframes.
+//   PATH: drawn from path triangles. Tex coords come from the position in the shape's extent.
+
 uniform mat3 modelview;
+#ifdef ANIMATED
+uniform float lerp_t1 = 0.0;
+uniform float lerp_t2 = 0.0;
+#endif
+#ifdef PATH
+// Takes path positions into the unit square of the shape's extent, same space as the fill quad.
+uniform mat3 to_unit = mat3(1.0);
+#endif
 
 in vec2 position;
 in vec2 tex_coord;
-in vec2 bezier_coord;
+in vec3 bezier_coord;
+in int segment_type;
+#ifdef ANIMATED
+in vec2 lerp_position1;
+in vec2 lerp_position2;
+in vec3 lerp_bezier_coord1;
+in vec3 lerp_bezier_coord2;
+#endif
 
 out vec2 frag_tex_coord;
-out vec2 frag_bezier_coord;
+out vec3 frag_bezier_coord;
+flat out int frag_segment_type;
 out vec2 screen_tex_coord;
 
 void main()
 {
-  frag_tex_coord = tex_coord;
+  vec2 vertex_position = position;
   frag_bezier_coord = bezier_coord;
-  vec2 screen_pos = (modelview * vec3(position, 1.0)).xy;
+#ifdef ANIMATED
+  vertex_position = mix(vertex_position, lerp_position1, lerp_t1);
+  vertex_position = mix(vertex_position, lerp_position2, lerp_t2);
+  frag_bezier_coord = mix(frag_bezier_coord, lerp_bezier_coord1, lerp_t1);
+  frag_bezier_coord = mix(frag_bezier_coord, lerp_bezier_coord2, lerp_t2);
+#endif
+#ifdef PATH
+  vertex_position = (to_unit * vec3(vertex_position, 1.0)).xy;
+  frag_tex_coord = vertex_position;
+#else
+  frag_tex_coord = tex_coord;
+#endif
+  frag_segment_type = segment_type;
+  vec2 screen_pos = (modelview * vec3(vertex_position, 1.0)).xy;
   screen_tex_coord = (screen_pos + vec2(1.0))/2.0;
   gl_Position = vec4(screen_pos, 0.0, 1.0);
 }
@@ -4,7 +4,12 @@ uniform vec4 color = vec4(1.0, 0.0, 0.0, 1.0);
 
 out vec4 out_color;
 
+float coverage();
+
 void main()
 {
+  float alpha = coverage();
+  if (alpha <= 0.0) discard;
   out_color = color;
+  out_color.a *= alpha;
 }
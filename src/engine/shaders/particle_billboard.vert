@@ -0,0 +1,46 @@
+#version 330
+
+// Same billboards as particle_draw.geom, but drawn as an instanced unit quad with a particle per
+// instance. The corner picks which one of the four we are.
+
+uniform mat4 transform3D;
+uniform mat3 transform2D;
+uniform vec3 camera_position;
+uniform float particle_radius;
+// Three texels per emitter, the size scale is in the third.
+uniform samplerBuffer emitters;
+
+in vec3 position;
+in vec4 color;
+in float visible;
+in vec2 tex_coord;
+in int emitter;
+
+out vec4 frag_color;
+out vec2 frag_tex_coord;
+// Distance from the camera, for weighting transparency.
+out float frag_depth;
+
+vec4 transform(vec3 position) {
+  vec4 projected_position = transform3D * vec4(position, 1.0);
+  // We need to homogenize here so we can apply the 2D transform.
+  vec2 screen_position = (transform2D * vec3(projected_position.xy / projected_position.w, 1.0)).xy;
+  return vec4(screen_position, 0.0, 1.0);
+}
+
+void main() {
+  frag_color = color;
+  frag_tex_coord = tex_coord;
+  frag_depth = (transform3D * vec4(position, 1.0)).w;
+  if (visible <= 0.0) {
+    // Outside the clip volume, so the quad is thrown away before rasterizing.
+    gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+    return;
+  }
+  vec3 to_camera = normalize(camera_position - position);
+  float radius = particle_radius * texelFetch(emitters, 3 * emitter + 2).y;
+  vec3 right = radius * cross(vec3(0.0, 1.0, 0.0), to_camera);
+  vec3 up = radius * cross(to_camera, vec3(1.0, 0.0, 0.0));
+  vec2 corner = tex_coord * 2.0 - 1.0;
+  gl_Position = transform(position + corner.x * right + corner.y * up);
+}
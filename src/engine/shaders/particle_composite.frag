@@ -0,0 +1,18 @@
+#version 330
+
+uniform sampler2D accumulation_texture;
+uniform sampler2D weight_texture;
+
+in vec2 frag_tex_coord;
+
+out vec4 out_color;
+
+// Weighted average of everything drawn here, covering as much as all of it together would.
+void main()
+{
+  vec4 accumulation = texture(accumulation_texture, frag_tex_coord);
+  float revealage = accumulation.a;
+  if (revealage >= 1.0) discard;
+  float weight = texture(weight_texture, frag_tex_coord).r;
+  out_color = vec4(accumulation.rgb / max(weight, 1e-5), 1.0 - revealage);
+}
@@ -1,13 +1,32 @@
 #version 330
 
+// Feature flags, defined by the engine right after the version line.
+//   WEIGHTED_OIT: accumulates into weighted blended transparency targets, see ParticleSystem.
+
 uniform sampler2D color_texture;
 
 in vec2 frag_tex_coord;
 in vec4 frag_color;
+in float frag_depth;
 
+#ifdef WEIGHTED_OIT
+// Premultiplied color times weight, with revealage in alpha. Then the summed alpha times weight.
+layout(location = 0) out vec4 accumulation;
+layout(location = 1) out vec4 weight;
+#else
 out vec4 out_color;
+#endif
 
 void main()
 {
-  out_color = frag_color * texture(color_texture, frag_tex_coord);
+  vec4 color = frag_color * texture(color_texture, frag_tex_coord);
+#ifdef WEIGHTED_OIT
+  // Nearer particles count for more. McGuire and Bavoil's distance weight, equation 7.
+  float distance_weight = clamp(10.0 / (1e-5 + pow(frag_depth / 5.0, 2.0) + pow(frag_depth / 200.0, 6.0)), 1e-2, 3e3);
+  float alpha_weight = color.a * distance_weight;
+  accumulation = vec4(color.rgb * alpha_weight, color.a);
+  weight = vec4(alpha_weight);
+#else
+  out_color = color;
+#endif
 }
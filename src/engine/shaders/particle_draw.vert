@@ -1,15 +1,21 @@
 #version 330
 
+// Three texels per emitter, the size scale is in the third.
+uniform samplerBuffer emitters;
+
 in vec3 position;
 in vec4 color;
 in float visible;
+in int emitter;
 
 out vec4 geom_color;
 out float geom_visible;
+out float geom_size;
 
 void main()
 {
   geom_visible = visible;
+  geom_size = texelFetch(emitters, 3 * emitter + 2).y;
   geom_color = color;
   gl_Position = vec4(position, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,16 @@
+#version 330
+
+out vec4 out_color;
+
+float coverage();
+
+void main()
+{
+  float alpha = coverage();
+  if (alpha <= 0.0) {  // Outside
+    gl_FragDepth = 1.0;
+    discard;
+  }
+  gl_FragDepth = 0.0;
+  out_color = vec4(1.0, 0.0, 0.0, alpha);
+}
@@ -0,0 +1,21 @@
+#version 330
+
+// Corners come already transformed to the screen.
+in vec2 position;
+in vec2 tex_coord;
+in vec4 color;
+in vec4 color_add;
+
+out vec2 frag_tex_coord;
+out vec2 screen_tex_coord;
+out vec4 frag_color_mul;
+out vec4 frag_color_add;
+
+void main()
+{
+  frag_tex_coord = tex_coord;
+  frag_color_mul = color;
+  frag_color_add = color_add;
+  screen_tex_coord = (position + vec2(1.0))/2.0;
+  gl_Position = vec4(position, 0.0, 1.0);
+}
@@ -0,0 +1,18 @@
+#version 330
+
+uniform sampler2D color_texture;
+
+in vec2 frag_tex_coord;
+
+out vec4 out_color;
+
+// Distance field glyphs are inside above one half. Filtering the distance rather than coverage keeps the
+// outline sharp however far we are scaled up. Coverage ramps over the pixel the edge crosses, so alpha to
+// coverage smooths it like the bitmap glyphs.
+void main()
+{
+  float distance = texture(color_texture, frag_tex_coord).r;
+  out_color.a = clamp((distance - 0.5) / max(fwidth(distance), 1e-5) + 0.5, 0.0, 1.0);
+  if (out_color.a == 0.0) discard;
+  out_color.r = 1.0;
+}
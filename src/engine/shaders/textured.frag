@@ -1,15 +1,42 @@
 #version 330
 
+// Feature flags, defined by the engine right after the version line.
+//   SHADOWED: darkened by the exposure texture from the god rays pass.
+//   BATCHED: color multiplier and addition come per vertex, with the texture scale in the tex coords.
+
 uniform sampler2D color_texture;
+#ifdef SHADOWED
+uniform sampler2D shadow_texture;
+#endif
+#ifdef BATCHED
+in vec4 frag_color_mul;
+in vec4 frag_color_add;
+#define color_mul frag_color_mul
+#define color_add frag_color_add
+const vec2 tex_scale = vec2(1.0, 1.0);
+#else
 uniform vec2 tex_scale = vec2(1.0, 1.0);
 uniform vec4 color_mul = vec4(1.0, 1.0, 1.0, 1.0);
 uniform vec4 color_add = vec4(0.0, 0.0, 0.0, 0.0);
+#endif
 
 in vec2 frag_tex_coord;
+#ifdef SHADOWED
+in vec2 screen_tex_coord;
+#endif
 
 out vec4 out_color;
 
+float coverage();
+
 void main()
 {
+  float alpha = coverage();
+  if (alpha <= 0.0) discard;
   out_color = color_mul * texture(color_texture, frag_tex_coord * tex_scale) + color_add;
+#ifdef SHADOWED
+  float exposure = texture(shadow_texture, screen_tex_coord).r;
+  out_color *= vec4(exposure, exposure, exposure, 1.0);
+#endif
+  out_color.a *= alpha;
 }
@@ -1,6 +1,9 @@
 #include "engine/shape.h"
 
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
 #include <sstream>
 #include <stdlib.h>
 
@@ -10,6 +13,17 @@
 #include "util/random.h"
 #include "util/transform2D.h"
 
+// Shapes spanning fewer pixels than this on screen are drawn from their flattened polygon.
+static const float kLodMaxPixels = 48.0f;
+// Segments each curve is flattened into. At the size above this keeps the error around a pixel in the
+// worst case. A fixed count means every keyframe of an animated shape flattens to the same vertex count.
+static const int kLodCurveSegments = 8;
+
+// Holds the geometry of every ShapeData, one pool for paths that never change and one for dynamic ones.
+// Declared first so they outlive the loaded data below.
+static ShapeBufferPool static_buffer_pool(GL_STATIC_DRAW);
+static ShapeBufferPool dynamic_buffer_pool(GL_DYNAMIC_DRAW);
+
 static map<string, ShapeData> loaded_shape_data;
 static ShapeData *loadIfNeeded(string filename) {
   if (loaded_shape_data.count(filename) == 0) {
@@ -18,9 +32,43 @@ static ShapeData *loadIfNeeded(string filename) {
   return &loaded_shape_data[filename];
 }
 
-ShapeData::ShapeData() : has_solids_(false), has_quadrics_(false) {}
+// Keyframes are built together, see ShapeData::initKeyframes, so a file can look different as a keyframe
+// than on its own. Kept apart from the files loaded alone, keyed by the list of frames and the index.
+static map<string, ShapeData> loaded_keyframe_data;
+static void loadKeyframeDataIfNeeded(const vector<NamedFile> &frames, string name, vector<ShapeData *> *data) {
+  bool loaded = loaded_keyframe_data.count(name + "0") != 0;
+  vector<string> filenames;
+  for (size_t i = 0; i < frames.size(); ++i) {
+    std::stringstream key;
+    key << name << i;
+    data->push_back(&loaded_keyframe_data[key.str()]);
+    filenames.push_back(frames[i].file);
+  }
+  if (!loaded) ShapeData::initKeyframes(*data, filenames);
+}
 
-ShapeData::~ShapeData() {}
+// VAOs for every keyframe triple of one list of frames, made up front so nothing is created mid game.
+// Shared by every shape animating through the same frames and freed along with the last of them.
+struct KeyframeArrays {
+  int references;
+  vector<GLuint> array_objects;
+};
+static map<string, KeyframeArrays> loaded_keyframe_arrays;
+
+ShapeData::ShapeData()
+  : allocated_(false),
+    dynamic_(false),
+    ears_stale_(false),
+    curves_size_(0),
+    lod_size_(0),
+    quadrics_first_(0),
+    cubics_first_(0),
+    per_frame_cubics_size_(0),
+    pool_(&static_buffer_pool) {}
+
+ShapeData::~ShapeData() {
+  if (allocated_) pool_->release(range_);
+}
 
 void ShapeData::init(string filename) {
   vector<PathVertex> vertices;
@@ -28,37 +76,71 @@ void ShapeData::init(string filename) {
   init(vertices);
 }
 
+static ShapeVertex makeShapeVertex(glm::vec2 position, glm::vec3 bezier_coord, PathVertexType segment_type) {
+  ShapeVertex vertex;
+  vertex.position = position;
+  vertex.bezier_coord = bezier_coord;
+  vertex.segment_type = segment_type;
+  return vertex;
+}
+
 void ShapeData::init(const vector<PathVertex> &vertices) {
+  initFrames(vector<ShapeData *>(1, this), vector<vector<PathVertex> >(1, vertices));
+}
+
+void ShapeData::initDynamic(const vector<PathVertex> &vertices) {
+  dynamic_ = true;
+  pool_ = &dynamic_buffer_pool;
+  path_ = vertices;
+  rebuild();
+}
+
+// Turns the path into triangles, all interleaved in one array.
+void ShapeData::build(const vector<PathVertex> &vertices, const vector<CubicPlan> *plans,
+  vector<ShapeVertex> *shape_vertices, vector<glm::vec2> *solids, vector<glm::vec2> *lod) {
   findCorners(vertices);
-  vector<glm::vec2> solids, quadrics, cubics, bezier_coords;
-  prepVertices(vertices, &solids, &quadrics, &cubics);
+  vector<glm::vec2> quadrics, cubics, bezier_coords, cubic_triangles;
+  vector<glm::vec3> cubic_coords;
+  prepVertices(vertices, solids, &quadrics, &cubics);
   makeBezierCoords(quadrics, &bezier_coords);
-  // Set members.
-  solids_size_ = solids.size();
-  has_solids_ = solids_size_ > 0;
-  quadrics_size_ = quadrics.size();
-  has_quadrics_ = quadrics_size_ > 0;
-  cubics_size_ = cubics.size();
-  has_cubics_ = cubics_size_ > 0;
-  // Send buffer data.
-  if (has_solids_) {
-    glGenBuffers(1, &solid_buffer_object_);
-    glBindBuffer(GL_ARRAY_BUFFER, solid_buffer_object_);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * solids.size(), &solids[0], GL_STATIC_DRAW);
-  }
-  if (has_quadrics_) {
-    glGenBuffers(1, &quadric_buffer_object_);
-    glBindBuffer(GL_ARRAY_BUFFER, quadric_buffer_object_);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * quadrics.size(), &quadrics[0], GL_STATIC_DRAW);
-    glGenBuffers(1, &bezier_coords_buffer_object_);
-    glBindBuffer(GL_ARRAY_BUFFER, bezier_coords_buffer_object_);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * bezier_coords.size(), &bezier_coords[0], GL_STATIC_DRAW);
-  }
-  if (has_cubics_) {
-    glGenBuffers(1, &cubic_buffer_object_);
-    glBindBuffer(GL_ARRAY_BUFFER, cubic_buffer_object_);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * cubics.size(), &cubics[0], GL_STATIC_DRAW);
+  if (plans != NULL) {
+    makeCubicTriangles(cubics, *plans, &cubic_triangles, &cubic_coords);
+  } else {
+    makeCubicTriangles(cubics, &cubic_triangles, &cubic_coords);
   }
+  makeLodVertices(vertices, lod);
+  // The solid fan becomes plain triangles so it can share a draw with the curves.
+  addFan(*solids, shape_vertices);
+  quadrics_first_ = shape_vertices->size();
+  for (size_t i = 0; i < quadrics.size(); ++i) {
+    shape_vertices->push_back(makeShapeVertex(quadrics[i], glm::vec3(bezier_coords[i], 0.0f), QUADRIC));
+  }
+  cubics_first_ = shape_vertices->size();
+  for (size_t i = 0; i < cubic_triangles.size(); ++i) {
+    shape_vertices->push_back(makeShapeVertex(cubic_triangles[i], cubic_coords[i], CUBIC));
+  }
+  curves_size_ = shape_vertices->size();
+  addFan(*lod, shape_vertices);
+  lod_size_ = shape_vertices->size() - curves_size_;
+  for (size_t i = 0; i < ears_.size(); ++i) {
+    shape_vertices->push_back(makeShapeVertex((*solids)[ears_[i]], glm::vec3(0.0f), ON_PATH));
+  }
+  per_frame_cubics_size_ = 0;
+  for (size_t i = 0; plans != NULL && i < plans->size(); ++i) {
+    if (!(*plans)[i].per_frame) continue;
+    for (int j = 0; j < 4; ++j) {
+      shape_vertices->push_back(makeShapeVertex(cubics[4 * i + j], glm::vec3(0.0f), CUBIC));
+    }
+    per_frame_cubics_size_ += 4;
+  }
+}
+
+GLuint ShapeData::bufferObject() {
+  return pool_->bufferObject(range_);
+}
+
+GLuint ShapeData::arrayObject() {
+  return pool_->arrayObject(range_);
 }
 
 void ShapeData::extent(glm::vec2 *min, glm::vec2 *max) {
@@ -95,7 +177,7 @@ void ShapeData::prepVertices(const vector<PathVertex> &vertices, vector<glm::vec
       cubics->push_back(vertices[i].position);
       cubics->push_back(vertices[i+1].position);
       cubics->push_back(vertices[i+2].position);
-      // Skip the next vertex its the other cubic control.
+      // Skip the next vertex, it's the other cubic control.
       ++i;
     }
   }
@@ -119,25 +201,670 @@ void ShapeData::makeBezierCoords(const vector<glm::vec2> &quadrics, vector<glm::
   }
 }
 
-Shape::Shape() : animated_(false), from_file_(false) {}
+// If we have non zero ws ever, use the actual dot cross.
+static float area(glm::vec2 p1, glm::vec2 p2, glm::vec2 p3) {
+  return (p1.x - p3.x) * (p2.y - p3.y) - (p2.x - p3.x) * (p1.y - p3.y);
+}
+
+static bool insideCurve(glm::vec3 b) {
+  return b.x * b.x * b.x - b.y * b.z <= 0;
+}
+
+// Within this of each other, keyframes split a cubic at the same t.
+static const float kSplitTolerance = 1e-3f;
+// Within this of a piece of cubic, in path units, a quadratic may stand in for it.
+static const float kQuadraticTolerance = 5e-4f;
+
+// Implicit bezier coords of a cubic and where to split it, at any double points or inflections in (0,1)
+// as in the Loop-Blinn paper. Cubics without them are split at harmless ts anyway, so every cubic makes
+// the same number of triangles.
+struct CubicClass {
+  enum Type { QUADRATIC, SERPENTINE, LOOP } type;
+  glm::vec3 b[4];
+  float t1, t2;
+};
+
+static void classifyCubic(const glm::vec2 p[4], CubicClass *cubic) {
+  // Maths for cubic classification
+  float a1 = area(p[0], p[3], p[2]);
+  float a2 = area(p[1], p[0], p[3]);
+  float a3 = area(p[2], p[1], p[0]);
+  // Normalize the areas to sum to one. This keeps what follows numerically stable. A flat curve has
+  // no area at all, and is treated as quadratic below.
+  float sum = a1 + a2 + a3;
+  if (sum == 0.0f) sum = 1.0f;
+  a1 /= sum;
+  a2 /= sum;
+  a3 /= sum;
+  float d1 = a1 - 2 * a2 + 3 * a3;
+  float d2 = -a2 + 3 * a3;
+  float d3 = 3 * a3;
+  float disc = d1 * d1 * (3 * d2 * d2 - 4 * d1 * d3);
+
+  // Classify and determine implicit bezier coordinates
+  glm::vec3 *b = cubic->b;
+  float rad, lu, mu, v;
+  if (d1 == 0 && d2 == 0) { // Quadratic
+    cubic->type = CubicClass::QUADRATIC;
+    lu = 2;
+    mu = 2;
+    v = 1;
+    b[0] = glm::vec3(0, 0, 0);
+    b[1] = glm::vec3(1.0f/3, 0, 1.0f/3);
+    b[2] = glm::vec3(2.0f/3, 1.0f/3, 2.0f/3);
+    b[3] = glm::vec3(1, 1, 1);
+  } else if (disc > 0) { // Serpentine
+    cubic->type = CubicClass::SERPENTINE;
+    rad = glm::sqrt(9 * d2 * d2 - 12 * d1 * d3);
+    lu = 3 * d2 - rad;
+    mu = 3 * d2 + rad;
+    v = 6 * d1;
+    b[0] = glm::vec3(lu * mu, lu * lu * lu, mu * mu * mu);
+    b[1] = glm::vec3((3 * lu * mu - lu * v  - v * mu) / 3,
+                     lu * lu * (lu - v),
+                     mu * mu * (mu - v));
+    b[2] = glm::vec3((v * (v - 2 * mu) + lu * (3 * mu - 2 * v)) / 3,
+                     (v - lu) * (v - lu) * lu,
+                     (v - mu) * (v - mu) * mu);
+    b[3] = glm::vec3((v - lu) * (v - mu),
+                     -(v - lu) * (v - lu) * (v - lu),
+                     -(v - mu) * (v - mu) * (v - mu));
+  } else { // Loop
+    cubic->type = CubicClass::LOOP;
+    rad = glm::sqrt(4 * d1 * d3 - 3 * d2 * d2);
+    lu = d2 - rad;
+    mu = d2 + rad;
+    v = 2 * d1;
+    b[0] = glm::vec3(lu * mu, lu * lu * mu, mu * mu * lu);
+    b[1] = glm::vec3((3 * lu * mu - lu * v - v * mu) / 3,
+                     -lu * (lu * (v - 3 * mu) + 2 * v * mu) / 3,
+                     -mu * (lu * (2 * v - 3 * mu) + v * mu) / 3);
+    b[2] = glm::vec3((v * (v - 2 * mu) + lu * (3 * mu - 2 * v)) / 3,
+                     (v - lu) * (lu * (2 * v - 3 * mu) + v * mu) / 3,
+                     (v - mu) * (lu * (v - 3 * mu) + 2 * v * mu) / 3);
+    b[3] = glm::vec3((v - lu) * (v - mu),
+                     -(v - lu) * (v - lu) * (v - mu),
+                     -(v - mu) * (v - mu) * (v - lu));
+  }
+
+  // Subdivide at intersection or inflection points in the interval (0,1).
+  float root_l = lu / v;
+  float root_m = mu / v;
+  float t1 = glm::min(root_l, root_m);
+  float t_last = glm::max(root_l, root_m);
+  if (!(t1 > 0.0f && t1 < 1.0f)) {
+    t1 = t_last;
+    t_last = -1.0f;
+  }
+  if (!(t1 > 0.0f && t1 < 1.0f)) t1 = 1.0f / 3;
+  // The second split is relative to what's left after the first.
+  float t2 = (t_last - t1) / (1.0f - t1);
+  if (!(t2 > 0.0f && t2 < 1.0f)) t2 = 0.5f;
+  cubic->t1 = t1;
+  cubic->t2 = t2;
+}
+
+// The three hulls a cubic is split into.
+struct CubicPieces {
+  glm::vec2 p[3][4];
+  glm::vec3 b[3][4];
+};
+
+// Splits at t1, then what's left at t2.
+static void splitCubic(const glm::vec2 p[4], const glm::vec3 b[4], float t1, float t2, CubicPieces *pieces) {
+  glm::vec2 rest_p[4] = {p[0], p[1], p[2], p[3]};
+  glm::vec3 rest_b[4] = {b[0], b[1], b[2], b[3]};
+  float ts[2] = {t1, t2};
+  for (int i = 0; i < 2; ++i) {
+    float t = ts[i];
+    glm::vec2 p12 = glm::mix(rest_p[0], rest_p[1], t), p23 = glm::mix(rest_p[1], rest_p[2], t);
+    glm::vec2 p34 = glm::mix(rest_p[2], rest_p[3], t);
+    glm::vec2 p123 = glm::mix(p12, p23, t), p234 = glm::mix(p23, p34, t);
+    glm::vec2 p1234 = glm::mix(p123, p234, t);
+    glm::vec3 b12 = glm::mix(rest_b[0], rest_b[1], t), b23 = glm::mix(rest_b[1], rest_b[2], t);
+    glm::vec3 b34 = glm::mix(rest_b[2], rest_b[3], t);
+    glm::vec3 b123 = glm::mix(b12, b23, t), b234 = glm::mix(b23, b34, t);
+    glm::vec3 b1234 = glm::mix(b123, b234, t);
+    glm::vec2 first_p[4] = {rest_p[0], p12, p123, p1234};
+    glm::vec3 first_b[4] = {rest_b[0], b12, b123, b1234};
+    std::copy(first_p, first_p + 4, pieces->p[i]);
+    std::copy(first_b, first_b + 4, pieces->b[i]);
+    // Our new hull is the second subdivision.
+    rest_p[0] = p1234;
+    rest_p[1] = p234;
+    rest_p[2] = p34;
+    rest_b[0] = b1234;
+    rest_b[1] = b234;
+    rest_b[2] = b34;
+  }
+  std::copy(rest_p, rest_p + 4, pieces->p[2]);
+  std::copy(rest_b, rest_b + 4, pieces->b[2]);
+}
+
+// Whether a hull's coords need flipping so the p1-p4 line is always inside.
+static bool hullFlipped(const glm::vec3 b[4]) {
+  return !insideCurve((b[0] + b[1] + b[2] + b[3]) / 4.0f);
+}
+
+// Adds the hull of a cubic curve with bezier coordinates as two triangles.
+static void emitHull(const glm::vec2 p[4], const glm::vec3 b[4], bool flipped, vector<glm::vec2> *triangles,
+  vector<glm::vec3> *cubic_coords) {
+  glm::vec3 flip = flipped ? glm::vec3(-1.0f, -1.0f, 1.0f) : glm::vec3(1.0f);
+  // Same order the old triangle strip used, p1 p4 p2 p3.
+  static const int kHullOrder[6] = {0, 3, 1, 3, 1, 2};
+  for (int i = 0; i < 6; ++i) {
+    triangles->push_back(p[kHullOrder[i]]);
+    cubic_coords->push_back(b[kHullOrder[i]] * flip);
+  }
+}
+
+// Each split leaves a triangle between the hulls, from its split point to both ends of what it split.
+// Their bezier coord makes our fragment shader fill in for every fragment. 24 vertices in all.
+static void emitCubic(const CubicPieces &pieces, const bool flips[3], vector<glm::vec2> *triangles,
+  vector<glm::vec3> *cubic_coords) {
+  for (int i = 0; i < 2; ++i) {
+    triangles->push_back(pieces.p[i][0]);
+    triangles->push_back(pieces.p[i][3]);
+    triangles->push_back(pieces.p[2][3]);
+    for (int j = 0; j < 3; ++j) cubic_coords->push_back(glm::vec3(0.0f, 1.0f, 1.0f));
+  }
+  for (int i = 0; i < 3; ++i) emitHull(pieces.p[i], pieces.b[i], flips[i], triangles, cubic_coords);
+}
+
+// Swaps each piece for the quadratic through its ends that is closest to it, raised to a cubic, and returns
+// how far the furthest one strays. Quadratic bezier coords don't depend on the curve, so they blend exactly.
+static float approximatePieces(CubicPieces *pieces) {
+  static const glm::vec3 kQuadraticCoords[4] = {
+    glm::vec3(0, 0, 0), glm::vec3(1.0f/3, 0, 1.0f/3), glm::vec3(2.0f/3, 1.0f/3, 2.0f/3), glm::vec3(1, 1, 1)
+  };
+  float error = 0.0f;
+  for (int i = 0; i < 3; ++i) {
+    glm::vec2 *p = pieces->p[i];
+    error = glm::max(error, glm::sqrt(3.0f) / 36 * glm::length(p[3] - 3.0f * p[2] + 3.0f * p[1] - p[0]));
+    glm::vec2 control = (3.0f * (p[1] + p[2]) - p[0] - p[3]) / 4.0f;
+    p[1] = glm::mix(p[0], control, 2.0f / 3);
+    p[2] = glm::mix(p[3], control, 2.0f / 3);
+    std::copy(kQuadraticCoords, kQuadraticCoords + 4, pieces->b[i]);
+  }
+  return error;
+}
+
+// Finds one exact plan for a cubic that every keyframe agrees with. They agree when their cubic is the same
+// type, split at about the same ts, with the same pieces flipped at the average ts.
+static bool planExactly(const vector<const vector<glm::vec2> *> &frames, size_t index, CubicPlan *plan) {
+  size_t num_frames = frames.size();
+  vector<CubicClass> classes(num_frames);
+  plan->t1 = plan->t2 = 0.0f;
+  for (size_t frame = 0; frame < num_frames; ++frame) {
+    classifyCubic(&(*frames[frame])[index], &classes[frame]);
+    if (classes[frame].type != classes[0].type) return false;
+    plan->t1 += classes[frame].t1 / num_frames;
+    plan->t2 += classes[frame].t2 / num_frames;
+  }
+  for (size_t frame = 0; frame < num_frames; ++frame) {
+    if (glm::abs(classes[frame].t1 - plan->t1) > kSplitTolerance ||
+        glm::abs(classes[frame].t2 - plan->t2) > kSplitTolerance) return false;
+    CubicPieces pieces;
+    splitCubic(&(*frames[frame])[index], classes[frame].b, plan->t1, plan->t2, &pieces);
+    for (int piece = 0; piece < 3; ++piece) {
+      bool flipped = hullFlipped(pieces.b[piece]);
+      if (frame == 0) {
+        plan->flips[piece] = flipped;
+      } else if (flipped != plan->flips[piece]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Failing that, keyframes can share quadratics on thirds of the cubic, if those stay close enough.
+static bool planQuadratics(const vector<const vector<glm::vec2> *> &frames, size_t index, CubicPlan *plan) {
+  plan->t1 = 1.0f / 3;
+  plan->t2 = 0.5f;
+  for (size_t frame = 0; frame < frames.size(); ++frame) {
+    CubicPieces pieces;
+    glm::vec3 unused[4];
+    splitCubic(&(*frames[frame])[index], unused, plan->t1, plan->t2, &pieces);
+    if (approximatePieces(&pieces) > kQuadraticTolerance) return false;
+    for (int piece = 0; piece < 3; ++piece) plan->flips[piece] = hullFlipped(pieces.b[piece]);
+  }
+  return true;
+}
+
+// One plan per cubic, shared by every keyframe, so blended coords stay close to the blended curve's. A cubic
+// neither kind of plan suits is drawn per frame. A single frame always agrees with itself.
+static void planCubics(const vector<const vector<glm::vec2> *> &frames, vector<CubicPlan> *plans) {
+  size_t num_cubics = frames[0]->size() / 4;
+  plans->resize(num_cubics);
+  for (size_t i = 0; i < num_cubics; ++i) {
+    CubicPlan &plan = (*plans)[i];
+    plan.quadratic = false;
+    plan.per_frame = false;
+    if (planExactly(frames, 4 * i, &plan)) continue;
+    plan.quadratic = planQuadratics(frames, 4 * i, &plan);
+    plan.per_frame = !plan.quadratic;
+  }
+}
+
+void ShapeData::makeCubicTriangles(const vector<glm::vec2> &cubics, vector<glm::vec2> *triangles,
+  vector<glm::vec3> *cubic_coords) {
+  vector<CubicPlan> plans;
+  planCubics(vector<const vector<glm::vec2> *>(1, &cubics), &plans);
+  makeCubicTriangles(cubics, plans, triangles, cubic_coords);
+}
+
+// Classifies each cubic (loop, serpentine or quadratic), finds implicit bezier coords and splits it as
+// planned. Cubics planned per frame are left out.
+void ShapeData::makeCubicTriangles(const vector<glm::vec2> &cubics, const vector<CubicPlan> &plans,
+  vector<glm::vec2> *triangles, vector<glm::vec3> *cubic_coords) {
+  for (size_t i = 0; i < cubics.size(); i += 4) {
+    const CubicPlan &plan = plans[i / 4];
+    if (plan.per_frame) continue;
+    CubicClass cubic;
+    classifyCubic(&cubics[i], &cubic);
+    CubicPieces pieces;
+    splitCubic(&cubics[i], cubic.b, plan.t1, plan.t2, &pieces);
+    if (plan.quadratic) approximatePieces(&pieces);
+    emitCubic(pieces, plan.flips, triangles, cubic_coords);
+  }
+}
+
+// Twice the signed area of a closed polygon, positive when it winds counter clockwise.
+static float polygonArea(const vector<glm::vec2> &polygon) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < polygon.size(); ++i) {
+    glm::vec2 p1 = polygon[i], p2 = polygon[(i + 1) % polygon.size()];
+    sum += p1.x * p2.y - p2.x * p1.y;
+  }
+  return sum;
+}
+
+// Whether segments p1-p2 and p3-p4 cross. Touching at an end doesn't count, so neighbours can share points.
+static bool segmentsCross(glm::vec2 p1, glm::vec2 p2, glm::vec2 p3, glm::vec2 p4) {
+  float a1 = area(p1, p2, p3), a2 = area(p1, p2, p4);
+  float a3 = area(p3, p4, p1), a4 = area(p3, p4, p2);
+  return ((a1 > 0 && a2 < 0) || (a1 < 0 && a2 > 0)) && ((a3 > 0 && a4 < 0) || (a3 < 0 && a4 > 0));
+}
+
+// Whether the closed polygon never crosses itself. Quadratic, but only run at load or after editing a
+// dynamic shape. A point visited twice
+// by non neighbours is the seam of several contours joined into one path, which doesn't count either.
+static bool isSimple(const vector<glm::vec2> &polygon) {
+  size_t size = polygon.size();
+  for (size_t i = 0; i < size; ++i) {
+    for (size_t j = i + 2; j < size; ++j) {
+      if (segmentsCross(polygon[i], polygon[i + 1], polygon[j], polygon[(j + 1) % size])) return false;
+      if (polygon[i] == polygon[j] && !(i == 0 && j == size - 1)) return false;
+    }
+  }
+  return true;
+}
+
+// Whether the corner at current is an ear of what's left of the polygon.
+static bool isEar(const vector<glm::vec2> &polygon, float winding, const vector<int> &remaining, int previous,
+  int current, int next) {
+  glm::vec2 p1 = polygon[previous], p2 = polygon[current], p3 = polygon[next];
+  // Reflex corners are never ears.
+  if (winding * area(p1, p2, p3) < 0) return false;
+  // Nor are corners with another point of the polygon inside, or on an edge.
+  for (size_t j = 0; j < remaining.size(); ++j) {
+    glm::vec2 p = polygon[remaining[j]];
+    if (p == p1 || p == p2 || p == p3) continue;
+    if (winding * area(p1, p2, p) >= 0 && winding * area(p2, p3, p) >= 0 && winding * area(p3, p1, p) >= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Ear clips simple polygons with the same number of points into one set of triangles, three indices each.
+// Keyframes are clipped together, taking only corners that are ears in every one. Fails if we ever run
+// out of ears, which means a polygon wasn't simple after all or the keyframes are too different.
+static bool earClip(const vector<const vector<glm::vec2> *> &polygons, const vector<float> &windings,
+  vector<int> *triangles) {
+  vector<int> remaining;
+  for (size_t i = 0; i < polygons[0]->size(); ++i) remaining.push_back(i);
+  while (remaining.size() > 3) {
+    size_t size = remaining.size();
+    bool clipped = false;
+    for (size_t i = 0; i < size && !clipped; ++i) {
+      int previous = remaining[(i + size - 1) % size], current = remaining[i], next = remaining[(i + 1) % size];
+      bool ear = true;
+      for (size_t frame = 0; frame < polygons.size() && ear; ++frame) {
+        ear = isEar(*polygons[frame], windings[frame], remaining, previous, current, next);
+      }
+      if (!ear) continue;
+      triangles->push_back(previous);
+      triangles->push_back(current);
+      triangles->push_back(next);
+      remaining.erase(remaining.begin() + i);
+      clipped = true;
+    }
+    if (!clipped) return false;
+  }
+  triangles->insert(triangles->end(), remaining.begin(), remaining.end());
+  return true;
+}
+
+// Checks the path can skip the stencil, finding which way the solids wind. Every curve must bulge away
+// from the solid polygon, with its controls strictly on the outside of its chord, so a curve's triangles
+// add to the shape but never take away. The polygon, and the path through the controls, must both be
+// simple so no two parts of the shape overlap. The solids are ear clipped after.
+static bool canFillDirectly(const vector<PathVertex> &vertices, const vector<glm::vec2> &solids, float *winding_out) {
+  if (solids.size() < 3) return false;
+  float winding = polygonArea(solids);
+  if (winding == 0.0f) return false;
+  winding = winding > 0.0f ? 1.0f : -1.0f;
+  *winding_out = winding;
+  vector<glm::vec2> controls;
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    controls.push_back(vertices[i].position);
+    if (vertices[i].type == ON_PATH) continue;
+    // A curve closing the path ends back at the start.
+    size_t end = vertices[i].type == QUADRIC ? i + 1 : i + 2;
+    glm::vec2 start = vertices[i-1].position, finish = vertices[end % vertices.size()].position;
+    for (size_t control = i; control < end; ++control) {
+      if (winding * area(start, finish, vertices[control].position) >= 0) return false;
+    }
+    if (vertices[i].type == CUBIC) {
+      // Skip the next vertex, it's the other cubic control.
+      ++i;
+      controls.push_back(vertices[i].position);
+    }
+  }
+  return isSimple(solids) && isSimple(controls);
+}
+
+void ShapeData::initKeyframes(const vector<ShapeData *> &frames, const vector<string> &filenames) {
+  vector<vector<PathVertex> > paths(frames.size());
+  for (size_t i = 0; i < frames.size(); ++i) frames[i]->readVertices(filenames[i], &paths[i]);
+  initFrames(frames, paths);
+}
+
+// Every keyframe has the same layout of path vertices, so the same solids and cubics line up.
+void ShapeData::initFrames(const vector<ShapeData *> &frames, const vector<vector<PathVertex> > &paths) {
+  size_t num_frames = frames.size();
+  vector<vector<glm::vec2> > solids(num_frames), quadrics(num_frames), cubics(num_frames);
+  vector<const vector<glm::vec2> *> frame_solids, frame_cubics;
+  for (size_t i = 0; i < num_frames; ++i) {
+    frames[i]->prepVertices(paths[i], &solids[i], &quadrics[i], &cubics[i]);
+    frame_solids.push_back(&solids[i]);
+    frame_cubics.push_back(&cubics[i]);
+  }
+  vector<CubicPlan> plans;
+  planCubics(frame_cubics, &plans);
+
+  // One pass fills need every keyframe fillable and the same ears in each. Cubics split on the GPU
+  // are only drawn in the stencil pass.
+  bool one_pass = true;
+  for (size_t i = 0; i < plans.size(); ++i) {
+    if (plans[i].per_frame) one_pass = false;
+  }
+  vector<float> windings(num_frames);
+  for (size_t i = 0; i < num_frames && one_pass; ++i) {
+    one_pass = solids[i].size() == solids[0].size() && canFillDirectly(paths[i], solids[i], &windings[i]);
+  }
+  vector<int> ears;
+  if (one_pass && !earClip(frame_solids, windings, &ears)) ears.clear();
+
+  for (size_t i = 0; i < num_frames; ++i) {
+    vector<ShapeVertex> shape_vertices;
+    vector<glm::vec2> built_solids, lod;
+    frames[i]->ears_ = ears;
+    frames[i]->build(paths[i], &plans, &shape_vertices, &built_solids, &lod);
+    // Send buffer data.
+    frames[i]->range_ = frames[i]->pool_->allocate(shape_vertices);
+    frames[i]->allocated_ = true;
+  }
+}
+
+// Walks the path and replaces each curve with line segments. The result is a polygon we can stencil
+// with a single fan, same as the solids but with the curve points mixed in.
+void ShapeData::makeLodVertices(const vector<PathVertex> &vertices, vector<glm::vec2> *lod) {
+  for (unsigned int i = 0; i < vertices.size(); ++i) {
+    PathVertexType type = vertices[i].type;
+    if (type == ON_PATH) {
+      lod->push_back(vertices[i].position);
+    } else {
+      glm::vec2 points[kLodCurveSegments - 1];
+      flattenCurve(vertices, i, points);
+      lod->insert(lod->end(), points, points + kLodCurveSegments - 1);
+      // Skip the next vertex, it's the other cubic control.
+      if (type == CUBIC) ++i;
+    }
+  }
+}
+
+// Points along the curve with its (first) control at index, not including the ends which are on the path.
+void ShapeData::flattenCurve(const vector<PathVertex> &vertices, size_t index, glm::vec2 *points) {
+  glm::vec2 p1 = vertices[index-1].position, p2 = vertices[index].position, p3 = vertices[index+1].position;
+  for (int segment = 1; segment < kLodCurveSegments; ++segment) {
+    float t = static_cast<float>(segment) / kLodCurveSegments;
+    if (vertices[index].type == QUADRIC) {
+      points[segment-1] = glm::mix(glm::mix(p1, p2, t), glm::mix(p2, p3, t), t);
+    } else {
+      glm::vec2 p4 = vertices[index+2].position;
+      glm::vec2 p12 = glm::mix(p1, p2, t), p23 = glm::mix(p2, p3, t), p34 = glm::mix(p3, p4, t);
+      points[segment-1] = glm::mix(glm::mix(p12, p23, t), glm::mix(p23, p34, t), t);
+    }
+  }
+}
+
+// Splits a triangle fan into separate triangles.
+void ShapeData::addFan(const vector<glm::vec2> &fan, vector<ShapeVertex> *shape_vertices) {
+  for (size_t i = 2; i < fan.size(); ++i) {
+    shape_vertices->push_back(makeShapeVertex(fan[0], glm::vec3(0.0f), ON_PATH));
+    shape_vertices->push_back(makeShapeVertex(fan[i-1], glm::vec3(0.0f), ON_PATH));
+    shape_vertices->push_back(makeShapeVertex(fan[i], glm::vec3(0.0f), ON_PATH));
+  }
+}
+
+void ShapeData::moveVertex(size_t index, glm::vec2 position) {
+  assert(dynamic_);
+  glm::vec2 old_position = path_[index].position;
+  path_[index].position = position;
+  // Extents only need a full pass if we moved off of one.
+  if (glm::any(glm::equal(old_position, min_corner_)) || glm::any(glm::equal(old_position, max_corner_))) {
+    findCorners(path_);
+  } else {
+    min_corner_ = glm::min(position, min_corner_);
+    max_corner_ = glm::max(position, max_corner_);
+  }
+  // Any move can make the path fillable in one pass or stop it being, checked once per flush.
+  ears_stale_ = true;
+
+  // Curves using this vertex have their control at most two before or one after it. Quadrics only reach
+  // one either way.
+  size_t first = index < 2 ? 0 : index - 2;
+  size_t last = glm::min(index + 1, path_.size() - 1);
+  for (size_t i = first; i <= last; ++i) {
+    if (curve_indices_[i] < 0) continue;
+    if (path_[i].type == QUADRIC && i + 1 < index) continue;
+    updateCurve(i);
+  }
+  if (solid_indices_[index] >= 0) {
+    solids_[solid_indices_[index]] = position;
+    updateFan(solids_, 0, solid_indices_[index]);
+    lod_[lod_indices_[index]] = position;
+    updateFan(lod_, curves_size_, lod_indices_[index]);
+  }
+}
+
+void ShapeData::insertVertex(size_t index, PathVertex vertex) {
+  assert(dynamic_);
+  path_.insert(path_.begin() + index, vertex);
+  rebuild();
+}
+
+void ShapeData::removeVertex(size_t index) {
+  assert(dynamic_);
+  path_.erase(path_.begin() + index);
+  rebuild();
+}
+
+bool ShapeData::flushEdits() {
+  bool edited = ears_stale_;
+  if (ears_stale_) updateEars();
+  if (dirty_.empty()) return edited;
+  // Merge overlapping and touching ranges so each stretch of the buffer goes up once.
+  std::sort(dirty_.begin(), dirty_.end());
+  size_t first = dirty_[0].first, end = first + dirty_[0].second;
+  for (size_t i = 1; i < dirty_.size(); ++i) {
+    if (dirty_[i].first > end) {
+      pool_->update(range_, first, end - first, &vertices_[first]);
+      first = dirty_[i].first;
+    }
+    end = glm::max(end, dirty_[i].first + dirty_[i].second);
+  }
+  pool_->update(range_, first, end - first, &vertices_[first]);
+  dirty_.clear();
+  return true;
+}
+
+// Redoes everything from the path. Keeps our range in the pool if the size didn't change.
+void ShapeData::rebuild() {
+  vector<ShapeVertex> old_vertices;
+  old_vertices.swap(vertices_);
+  solids_.clear();
+  lod_.clear();
+  ears_.clear();
+  build(path_, NULL, &vertices_, &solids_, &lod_);
+  // Room for the most ears the solids can have, so clipping again after an edit never resizes us.
+  if (solids_.size() >= 3) vertices_.resize(earVerticesFirst() + 3 * (solids_.size() - 2));
+  mapPath();
+  dirty_.clear();
+  ears_stale_ = true;
+  if (allocated_ && range_.count == vertices_.size()) {
+    markDirty(0, vertices_.size());
+  } else {
+    if (allocated_) pool_->release(range_);
+    range_ = pool_->allocate(vertices_);
+    allocated_ = true;
+  }
+}
+
+// Checks the path can still skip the stencil and clips its ears again. A simple polygon always clips into
+// the same number of ears, which fit the room rebuild left for them.
+void ShapeData::updateEars() {
+  ears_stale_ = false;
+  ears_.clear();
+  float winding;
+  if (canFillDirectly(path_, solids_, &winding) &&
+      !earClip(vector<const vector<glm::vec2> *>(1, &solids_), vector<float>(1, winding), &ears_)) {
+    ears_.clear();
+  }
+  size_t first = earVerticesFirst();
+  for (size_t i = 0; i < ears_.size(); ++i) {
+    vertices_[first + i] = makeShapeVertex(solids_[ears_[i]], glm::vec3(0.0f), ON_PATH);
+  }
+  if (!ears_.empty()) markDirty(first, ears_.size());
+}
+
+// Finds where each path vertex ended up, walking the path the same way build does.
+void ShapeData::mapPath() {
+  solid_indices_.assign(path_.size(), -1);
+  curve_indices_.assign(path_.size(), -1);
+  lod_indices_.assign(path_.size(), -1);
+  int solids = 0, quadrics = 0, cubics = 0, lod = 0;
+  for (size_t i = 0; i < path_.size(); ++i) {
+    PathVertexType type = path_[i].type;
+    if (type == ON_PATH) {
+      solid_indices_[i] = solids++;
+      lod_indices_[i] = lod++;
+    } else {
+      curve_indices_[i] = type == QUADRIC ? quadrics++ : cubics++;
+      lod_indices_[i] = lod;
+      lod += kLodCurveSegments - 1;
+      // Skip the next vertex, it's the other cubic control.
+      if (type == CUBIC) ++i;
+    }
+  }
+}
+
+// Redoes the triangles and flattened points of the curve with its (first) control at index.
+void ShapeData::updateCurve(size_t index) {
+  int curve = curve_indices_[index];
+  if (path_[index].type == QUADRIC) {
+    size_t first = quadrics_first_ + 3 * curve;
+    for (int i = 0; i < 3; ++i) {
+      vertices_[first + i].position = path_[index - 1 + i].position;
+    }
+    markDirty(first, 3);
+  } else {
+    vector<glm::vec2> cubic, triangles;
+    vector<glm::vec3> cubic_coords;
+    for (int i = 0; i < 4; ++i) cubic.push_back(path_[index - 1 + i].position);
+    makeCubicTriangles(cubic, &triangles, &cubic_coords);
+    size_t first = cubics_first_ + triangles.size() * curve;
+    for (size_t i = 0; i < triangles.size(); ++i) {
+      vertices_[first + i] = makeShapeVertex(triangles[i], cubic_coords[i], CUBIC);
+    }
+    markDirty(first, triangles.size());
+  }
+  flattenCurve(path_, index, &lod_[lod_indices_[index]]);
+  for (int i = 0; i < kLodCurveSegments - 1; ++i) {
+    updateFan(lod_, curves_size_, lod_indices_[index] + i);
+  }
+}
+
+// Redoes the fan triangles using one point. The fan's triangles start at vertex first.
+void ShapeData::updateFan(const vector<glm::vec2> &fan, size_t first, size_t point) {
+  if (fan.size() < 3) return;
+  size_t triangles = fan.size() - 2;
+  // Every triangle uses the first point. Otherwise point i is in triangles i-2 and i-1.
+  size_t first_triangle = point < 2 ? 0 : point - 2;
+  size_t last_triangle = point == 0 ? triangles - 1 : glm::min(point - 1, triangles - 1);
+  for (size_t i = first_triangle; i <= last_triangle; ++i) {
+    vertices_[first + 3 * i].position = fan[0];
+    vertices_[first + 3 * i + 1].position = fan[i + 1];
+    vertices_[first + 3 * i + 2].position = fan[i + 2];
+  }
+  markDirty(first + 3 * first_triangle, 3 * (last_triangle - first_triangle + 1));
+}
+
+void ShapeData::markDirty(size_t first, size_t count) {
+  dirty_.push_back(std::make_pair(first, count));
+}
+
+Shape::Shape() : animated_(false), from_file_(false), one_pass_(false), keyframe_array_objects_(NULL) {}
 
 Shape::~Shape() {
   if (!from_file_) delete data_;
+  if (animated_) {
+    KeyframeArrays &arrays = loaded_keyframe_arrays[keyframes_name_];
+    if (--arrays.references == 0) {
+      glDeleteVertexArrays(arrays.array_objects.size(), &arrays.array_objects[0]);
+      loaded_keyframe_arrays.erase(keyframes_name_);
+    }
+  }
 }
 
 void Shape::init(const vector<PathVertex> &vertices) {
   from_file_ = false;
   data_ = new ShapeData();
   data_->init(vertices);
-  data_->extent(&min_, &max_);
-  createVAOs();
+  one_pass_ = findOnePass();
+}
+
+// Not ours to delete, same as data from a file.
+void Shape::init(ShapeData *data) {
+  from_file_ = true;
+  data_ = data;
+  one_pass_ = findOnePass();
+}
+
+void Shape::initDynamic(const vector<PathVertex> &vertices) {
+  from_file_ = false;
+  data_ = new ShapeData();
+  data_->initDynamic(vertices);
+  one_pass_ = findOnePass();
 }
 
 void Shape::init(string filename) {
   from_file_ = true;
   data_ = loadIfNeeded(filename);
-  data_->extent(&min_, &max_);
-  createVAOs();
+  one_pass_ = findOnePass();
 }
 
 void Shape::init(const vector<NamedFile> &frames, Animator *animator) {
@@ -146,179 +873,203 @@ void Shape::init(const vector<NamedFile> &frames, Animator *animator) {
 
   min_ = glm::vec2(std::numeric_limits<float>::max());
   max_ = glm::vec2(-std::numeric_limits<float>::max());
+  keyframes_name_.clear();
   for (vector<NamedFile>::const_iterator it = frames.begin(); it != frames.end(); ++it) {
-    ShapeData *data = loadIfNeeded(it->file);
+    keyframes_name_ += it->file + ";";
+  }
+  loadKeyframeDataIfNeeded(frames, keyframes_name_, &frames_);
+  for (vector<ShapeData *>::iterator it = frames_.begin(); it != frames_.end(); ++it) {
     glm::vec2 frame_min, frame_max;
-    data->extent(&frame_min, &frame_max);
+    (*it)->extent(&frame_min, &frame_max);
     min_ = glm::min(frame_min, min_);
     max_ = glm::max(frame_max, max_);
-    frames_[it->name] = data;
   }
-  data_ = frames_.begin()->second;
+  data_ = frames_[0];
   animator_ = animator;
-  createVAOs();
-}
-
-// Prepare GL to draw paths and build indices for each bezier level.
-void Shape::createVAOs() {
-  // Set up the solid path traingles VAO
-  if (data_->hasSolidVertices()) {
-    glGenVertexArrays(1, &solid_array_object_);
-    glBindVertexArray(solid_array_object_);
-    if (animated_) {
-      glEnableVertexAttribArray(theEngine().attributeHandle("position"));
-      glEnableVertexAttribArray(theEngine().attributeHandle("lerp_position1"));
-      glEnableVertexAttribArray(theEngine().attributeHandle("lerp_position2"));
-    } else {
-      glBindBuffer(GL_ARRAY_BUFFER, data_->solidBufferObject());
-      GLuint handle = theEngine().attributeHandle("position");
-      glEnableVertexAttribArray(handle);
-      glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-    }
-  }
+  keyframe_array_objects_ = loadKeyframesIfNeeded();
+  one_pass_ = findOnePass();
+}
 
-  // Set up the quadric triangles VAO
-  if (data_->hasQuadricVertices()) {
-    glGenVertexArrays(1, &quadric_array_object_);
-    glBindVertexArray(quadric_array_object_);
-    if (animated_) {
-      glEnableVertexAttribArray(theEngine().attributeHandle("position"));
-      glEnableVertexAttribArray(theEngine().attributeHandle("lerp_position1"));
-      glEnableVertexAttribArray(theEngine().attributeHandle("lerp_position2"));
-      glEnableVertexAttribArray(theEngine().attributeHandle("bezier_coord"));
-    } else {
-      // Set up the quadric vertices vertex buffer
-      glBindBuffer(GL_ARRAY_BUFFER, data_->quadricBufferObject());
-      GLuint handle = theEngine().attributeHandle("position");
-      glEnableVertexAttribArray(handle);
-      glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-
-      // Pass in the bezier texture coords.
-      glBindBuffer(GL_ARRAY_BUFFER, data_->bezierCoordsBufferObject());
-      handle = theEngine().attributeHandle("bezier_coord");
-      glEnableVertexAttribArray(handle);
-      glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-    }
-  }
+// Edits can make a dynamic shape fillable in one pass, or stop it being.
+void Shape::flushEdits() {
+  if (data_->flushEdits()) one_pass_ = findOnePass();
+}
 
-  // Set up the cubic triangles VAO
-  if (data_->hasCubicVertices()) {
-    glGenVertexArrays(1, &cubic_array_object_);
-    glBindVertexArray(cubic_array_object_);
-    if (animated_) {
-      glEnableVertexAttribArray(theEngine().attributeHandle("position"));
-      glEnableVertexAttribArray(theEngine().attributeHandle("lerp_position1"));
-      glEnableVertexAttribArray(theEngine().attributeHandle("lerp_position2"));
-    } else {
-      // Set up the quadric vertices vertex buffer
-      glBindBuffer(GL_ARRAY_BUFFER, data_->cubicBufferObject());
-      GLuint handle = theEngine().attributeHandle("position");
-      glEnableVertexAttribArray(handle);
-      glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-    }
+bool Shape::findOnePass() {
+  if (data_->earVerticesSize() == 0) return false;
+  // Keyframes blend vertex for vertex, so they also need the same ears.
+  for (vector<ShapeData *>::iterator it = frames_.begin(); it != frames_.end(); ++it) {
+    if ((*it)->ears() != data_->ears()) return false;
   }
+  return true;
 }
 
-void Shape::bindKeyframeBuffers() {
-  string keyframe_names[3];
-  animator_->currentState(keyframe_names, lerp_ts_);
-
-  ShapeData *keyframe1 = frames_[keyframe_names[0]];
-  ShapeData *keyframe2 = frames_[keyframe_names[1]];
-  ShapeData *keyframe3 = frames_[keyframe_names[2]];
-  if (data_->hasSolidVertices()) {
-    glBindVertexArray(solid_array_object_);
-    glBindBuffer(GL_ARRAY_BUFFER, keyframe1->solidBufferObject());
-    glVertexAttribPointer(theEngine().attributeHandle("position"), 2, GL_FLOAT, GL_FALSE, 0, NULL);
+// Offset of an attribute of a shape's first vertex in its pool buffer.
+static void *vertexOffset(ShapeData *data, size_t attribute_offset) {
+  return (void *)(sizeof(ShapeVertex) * data->firstVertex() + attribute_offset);
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, keyframe2->solidBufferObject());
-    glVertexAttribPointer(theEngine().attributeHandle("lerp_position1"), 2, GL_FLOAT, GL_FALSE, 0, NULL);
+// Makes the VAO blending three keyframes. Keyframes may sit anywhere in the pool, so the offsets are baked
+// into the pointers and we draw from vertex zero.
+static GLuint makeKeyframeArrayObject(ShapeData *keyframe1, ShapeData *keyframe2, ShapeData *keyframe3) {
+  GLuint array_object;
+  glGenVertexArrays(1, &array_object);
+  glBindVertexArray(array_object);
+  glEnableVertexAttribArray(theEngine().attributeHandle("position"));
+  glEnableVertexAttribArray(theEngine().attributeHandle("lerp_position1"));
+  glEnableVertexAttribArray(theEngine().attributeHandle("lerp_position2"));
+  glEnableVertexAttribArray(theEngine().attributeHandle("bezier_coord"));
+  glEnableVertexAttribArray(theEngine().attributeHandle("lerp_bezier_coord1"));
+  glEnableVertexAttribArray(theEngine().attributeHandle("lerp_bezier_coord2"));
+  glEnableVertexAttribArray(theEngine().attributeHandle("segment_type"));
 
-    glBindBuffer(GL_ARRAY_BUFFER, keyframe3->solidBufferObject());
-    glVertexAttribPointer(theEngine().attributeHandle("lerp_position2"), 2, GL_FLOAT, GL_FALSE, 0, NULL);
-  }
-  if (data_->hasQuadricVertices()) {
-    glBindVertexArray(quadric_array_object_);
-    glBindBuffer(GL_ARRAY_BUFFER, keyframe1->quadricBufferObject());
-    glVertexAttribPointer(theEngine().attributeHandle("position"), 2, GL_FLOAT, GL_FALSE, 0, NULL);
+  // Segment types match across keyframes, so they just come from the first.
+  glBindBuffer(GL_ARRAY_BUFFER, keyframe1->bufferObject());
+  glVertexAttribPointer(theEngine().attributeHandle("position"), 2, GL_FLOAT, GL_FALSE, sizeof(ShapeVertex),
+    vertexOffset(keyframe1, offsetof(ShapeVertex, position)));
+  glVertexAttribPointer(theEngine().attributeHandle("bezier_coord"), 3, GL_FLOAT, GL_FALSE, sizeof(ShapeVertex),
+    vertexOffset(keyframe1, offsetof(ShapeVertex, bezier_coord)));
+  glVertexAttribIPointer(theEngine().attributeHandle("segment_type"), 1, GL_INT, sizeof(ShapeVertex),
+    vertexOffset(keyframe1, offsetof(ShapeVertex, segment_type)));
 
-    glBindBuffer(GL_ARRAY_BUFFER, keyframe2->quadricBufferObject());
-    glVertexAttribPointer(theEngine().attributeHandle("lerp_position1"), 2, GL_FLOAT, GL_FALSE, 0, NULL);
+  // The keyframes share cubic plans, so their blended bezier coords follow the blended curve.
+  glBindBuffer(GL_ARRAY_BUFFER, keyframe2->bufferObject());
+  glVertexAttribPointer(theEngine().attributeHandle("lerp_position1"), 2, GL_FLOAT, GL_FALSE, sizeof(ShapeVertex),
+    vertexOffset(keyframe2, offsetof(ShapeVertex, position)));
+  glVertexAttribPointer(theEngine().attributeHandle("lerp_bezier_coord1"), 3, GL_FLOAT, GL_FALSE, sizeof(ShapeVertex),
+    vertexOffset(keyframe2, offsetof(ShapeVertex, bezier_coord)));
 
-    glBindBuffer(GL_ARRAY_BUFFER, keyframe3->quadricBufferObject());
-    glVertexAttribPointer(theEngine().attributeHandle("lerp_position2"), 2, GL_FLOAT, GL_FALSE, 0, NULL);
+  glBindBuffer(GL_ARRAY_BUFFER, keyframe3->bufferObject());
+  glVertexAttribPointer(theEngine().attributeHandle("lerp_position2"), 2, GL_FLOAT, GL_FALSE, sizeof(ShapeVertex),
+    vertexOffset(keyframe3, offsetof(ShapeVertex, position)));
+  glVertexAttribPointer(theEngine().attributeHandle("lerp_bezier_coord2"), 3, GL_FLOAT, GL_FALSE, sizeof(ShapeVertex),
+    vertexOffset(keyframe3, offsetof(ShapeVertex, bezier_coord)));
+  glBindVertexArray(0);
+  return array_object;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, keyframe1->bezierCoordsBufferObject());
-    glVertexAttribPointer(theEngine().attributeHandle("bezier_coord"), 2, GL_FLOAT, GL_FALSE, 0, NULL);
+// Finds the shared VAOs for our frames, making one for every triple if we're the first to use them. Groups
+// only have a handful of frames, so every triple is cheap enough.
+const vector<GLuint> *Shape::loadKeyframesIfNeeded() {
+  KeyframeArrays &arrays = loaded_keyframe_arrays[keyframes_name_];
+  if (arrays.array_objects.empty()) {
+    arrays.references = 0;
+    for (size_t i = 0; i < frames_.size(); ++i) {
+      for (size_t j = 0; j < frames_.size(); ++j) {
+        for (size_t k = 0; k < frames_.size(); ++k) {
+          arrays.array_objects.push_back(makeKeyframeArrayObject(frames_[i], frames_[j], frames_[k]));
+        }
+      }
+    }
   }
-  if (data_->hasCubicVertices()) {
-    glBindVertexArray(cubic_array_object_);
-    glBindBuffer(GL_ARRAY_BUFFER, keyframe1->cubicBufferObject());
-    glVertexAttribPointer(theEngine().attributeHandle("position"), 2, GL_FLOAT, GL_FALSE, 0, NULL);
+  ++arrays.references;
+  return &arrays.array_objects;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, keyframe2->cubicBufferObject());
-    glVertexAttribPointer(theEngine().attributeHandle("lerp_position1"), 2, GL_FLOAT, GL_FALSE, 0, NULL);
+GLuint Shape::keyframeArrayObject() {
+  AnimationState state;
+  animator_->currentState(&state);
+  lerp_ts_[0] = state.lerp_ts[0];
+  lerp_ts_[1] = state.lerp_ts[1];
+  size_t index = 0;
+  for (int i = 0; i < 3; ++i) {
+    index = index * frames_.size() + state.frames[i];
+  }
+  return (*keyframe_array_objects_)[index];
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, keyframe3->cubicBufferObject());
-    glVertexAttribPointer(theEngine().attributeHandle("lerp_position2"), 2, GL_FLOAT, GL_FALSE, 0, NULL);
+void Shape::extent(glm::vec2 *min, glm::vec2 *max) {
+  if (animated_) {
+    *min = min_;
+    *max = max_;
+  } else {
+    // Dynamic data can change shape under us.
+    data_->extent(min, max);
   }
 }
 
-void Shape::drawHelper(bool asOccluder) {
-  if (animated_) bindKeyframeBuffers();
+bool Shape::useLod() {
+  glm::vec2 min, max;
+  screenExtent(&min, &max);
+  glm::vec2 pixel_size = theEngine().screenToPixels(max - min);
+  return glm::max(pixel_size.x, pixel_size.y) < kLodMaxPixels;
+}
 
-  // Ready stencil drawing.
-  glEnable(GL_STENCIL_TEST);
-  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
-  glStencilFunc(GL_ALWAYS, 0, 1);
-  glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+// Stencilled shapes sort after one pass shapes, they change more state.
+uint64_t Shape::drawKey(bool asOccluder) {
+  flushEdits();
+  bool one_pass = one_pass_ && !useLod();
+  unsigned int flags = one_pass ? PATH : 0;
+  if (one_pass && animated_) flags |= ANIMATED;
+  GLuint program, texture;
+  fill()->drawState(flags, asOccluder, &program, &texture);
+  GLuint array_object = animated_ ? keyframeArrayObject() : data_->arrayObject();
+  return makeDrawKey(one_pass ? 0 : 1, program, texture, array_object);
+}
 
-  // Draw solid and quadric triangles, inverting the stencil each time.
-  if (data_->hasSolidVertices()) {
-    if (animated_) {
-      theEngine().useProgram("minimal_animated");
-      glUniform1f(theEngine().uniformHandle("lerp_t1"), lerp_ts_[0]);
-      glUniform1f(theEngine().uniformHandle("lerp_t2"), lerp_ts_[1]);
-    } else {
-      theEngine().useProgram("minimal");
-    }
-    glUniform4fv(theEngine().uniformHandle("color"), 1, glm::value_ptr(glm::vec4(1.0f)));
-    glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(fullTransform()));
-    glBindVertexArray(solid_array_object_);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, data_->solidVerticesSize());
+void Shape::drawHelper(bool asOccluder) {
+  GLuint array_object;
+  size_t first = 0;
+  if (animated_) {
+    array_object = keyframeArrayObject();
+  } else {
+    array_object = data_->arrayObject();
+    first = data_->firstVertex();
   }
+  flushEdits();
+  bool lod = useLod();
 
-  if (data_->hasQuadricVertices()) {
-    if (animated_) {
-      theEngine().useProgram("quadric_animated");
-      glUniform1f(theEngine().uniformHandle("lerp_t1"), lerp_ts_[0]);
-      glUniform1f(theEngine().uniformHandle("lerp_t2"), lerp_ts_[1]);
+  // Simple paths skip the stencil, the fill draws the ears and curves itself.
+  if (one_pass_ && !lod) {
+    PathGeometry path;
+    path.array_object = array_object;
+    path.firsts[0] = first + data_->earVerticesFirst();
+    path.counts[0] = data_->earVerticesSize();
+    path.firsts[1] = first + data_->curvesOnlyFirst();
+    path.counts[1] = data_->curvesOnlySize();
+    path.animated = animated_;
+    path.lerp_ts[0] = lerp_ts_[0];
+    path.lerp_ts[1] = lerp_ts_[1];
+    if (asOccluder) {
+      fill()->fillInPathOccluder(this, path);
     } else {
-      theEngine().useProgram("quadric");
+      fill()->fillInPath(this, path);
     }
-    glEnable(GL_DEPTH_TEST);
-    glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(fullTransform()));
-    glBindVertexArray(quadric_array_object_);
-    glDrawArrays(GL_TRIANGLES, 0, data_->quadricVerticesSize());
-    glDisable(GL_DEPTH_TEST);
+    return;
   }
 
-  if (data_->hasCubicVertices()) {
-    if (animated_) {
-      theEngine().useProgram("cubic_animated");
+  if (animated_) {
+    theEngine().useProgram("path", ANIMATED);
+    glUniform1f(theEngine().uniformHandle("lerp_t1"), lerp_ts_[0]);
+    glUniform1f(theEngine().uniformHandle("lerp_t2"), lerp_ts_[1]);
+  } else {
+    theEngine().useProgram("path");
+  }
+  glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(fullTransform()));
+
+  // Ready stencil drawing.
+  glEnable(GL_STENCIL_TEST);
+  glEnable(GL_DEPTH_TEST);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glStencilFunc(GL_ALWAYS, 0, 1);
+  glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+
+  // Draw solid and curve triangles in one go, inverting the stencil each time.
+  glBindVertexArray(array_object);
+  if (lod) {
+    glDrawArrays(GL_TRIANGLES, first + data_->curveVerticesSize(), data_->lodVerticesSize());
+  } else {
+    glDrawArrays(GL_TRIANGLES, first, data_->curveVerticesSize());
+    // Cubics the keyframes disagree on, split from the blended control points.
+    if (data_->perFrameCubicsSize() > 0) {
+      theEngine().useProgram("path_cubic", ANIMATED);
       glUniform1f(theEngine().uniformHandle("lerp_t1"), lerp_ts_[0]);
       glUniform1f(theEngine().uniformHandle("lerp_t2"), lerp_ts_[1]);
-    } else {
-      theEngine().useProgram("cubic");
+      glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(fullTransform()));
+      glDrawArrays(GL_LINES_ADJACENCY, first + data_->perFrameCubicsFirst(), data_->perFrameCubicsSize());
     }
-    glEnable(GL_DEPTH_TEST);
-    glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(fullTransform()));
-    glBindVertexArray(cubic_array_object_);
-    // GL_LINES_AJACENCY lets us pass four verts to the geometry shader at a
-    // time, without needing to hide extra vertex data in varyings
-    glDrawArrays(GL_LINES_ADJACENCY, 0, data_->cubicVerticesSize());
-    glDisable(GL_DEPTH_TEST);
   }
+  glDisable(GL_DEPTH_TEST);
 
   // Draw a quad over the whole shape and test with stencil.
   glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
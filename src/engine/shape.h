@@ -6,9 +6,11 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <utility>
 
 #include "engine/fill.h"
 #include "engine/shader_program.h"
+#include "engine/shape_buffer_pool.h"
 #include "engine/animator.h"
 
 using std::string;
@@ -26,37 +28,105 @@ struct PathVertex {
   PathVertexType type;
 };
 
+// Where one cubic is split and which of its three pieces are flipped. Keyframes of an animated shape share
+// a plan per cubic, so their bezier coords still line up when blended. Keyframes that classify a cubic
+// differently can share quadratics close to each piece instead. A cubic no plan suits in every keyframe
+// is drawn per frame, from its blended control points.
+struct CubicPlan {
+  bool per_frame;
+  bool quadratic;
+  float t1, t2;
+  bool flips[3];
+};
+
 class ShapeData { 
   public:
     ShapeData();
     ~ShapeData();
     void init(string filename);
     void init(const vector<PathVertex> &vertices);
+    // Builds the keyframes of an animated shape together, one file each, so they share cubic plans and
+    // ears.
+    static void initKeyframes(const vector<ShapeData *> &frames, const vector<string> &filenames);
+    // A dynamic shape keeps its path around so it can be edited in place. Edits only redo the triangles of
+    // the segments they touch, and are sent to GL in one go by flushEdits.
+    void initDynamic(const vector<PathVertex> &vertices);
     void extent(glm::vec2 *min, glm::vec2 *max);
-    // Solids.
-    bool hasSolidVertices() { return has_solids_; }
-    size_t solidVerticesSize() { return solids_size_; }
-    GLuint solidBufferObject() { return solid_buffer_object_; }
-    // Quadrics.
-    bool hasQuadricVertices() { return has_quadrics_; }
-    size_t quadricVerticesSize() { return quadrics_size_; }
-    GLuint quadricBufferObject() { return quadric_buffer_object_; }
-    GLuint bezierCoordsBufferObject() { return bezier_coords_buffer_object_; }
-    // Cubics.
-    bool hasCubicVertices() { return has_cubics_; }
-    size_t cubicVerticesSize() { return cubics_size_; }
-    GLuint cubicBufferObject() { return cubic_buffer_object_; }
+    // Where our vertices start in the shared pool buffer.
+    size_t firstVertex() { return range_.first; }
+    // Solid, quadric and cubic triangles. Cubics are already classified and subdivided.
+    size_t curveVerticesSize() { return curves_size_; }
+    // Flattened polygon, drawn in place of the curves when the shape is small on screen. Follows right
+    // after the curves.
+    size_t lodVerticesSize() { return lod_size_; }
+    // Just the quadric and cubic triangles, without the solid fan.
+    size_t curvesOnlyFirst() { return quadrics_first_; }
+    size_t curvesOnlySize() { return curves_size_ - quadrics_first_; }
+    // The solids ear clipped rather than fanned, after the lod vertices. Only there when the path can be
+    // filled in one pass, without the stencil: the solids make a simple polygon and every curve bulges
+    // outwards, so curve triangles only ever add to the shape. Dynamic shapes clip again after edits.
+    size_t earVerticesFirst() { return curves_size_ + lod_size_; }
+    size_t earVerticesSize() { return ears_.size(); }
+    // Which solids each ear uses, three per triangle. Keyframes can share a one pass fill if these match.
+    const vector<int> &ears() { return ears_; }
+    // Control points of the cubics keyframes couldn't agree on a plan for, four each, after the ears.
+    // Their triangles are left out of the curves, they're split on the GPU each frame. Never for shapes
+    // with ears.
+    size_t perFrameCubicsFirst() { return earVerticesFirst() + ears_.size(); }
+    size_t perFrameCubicsSize() { return per_frame_cubics_size_; }
+    GLuint bufferObject();
+    // Shared by every shape in the same pool block, ready to draw with firstVertex().
+    GLuint arrayObject();
+
+    // =====Dynamic shapes only=====
+    const vector<PathVertex> &path() { return path_; }
+    void moveVertex(size_t index, glm::vec2 position);
+    // Inserting and removing change how many triangles we have, so they redo the whole shape. Still no
+    // new GL objects, the range in the pool is reused or swapped for another.
+    void insertVertex(size_t index, PathVertex vertex);
+    void removeVertex(size_t index);
+    // Uploads every vertex range changed since the last flush, clipping ears again first if the path
+    // moved. Returns whether anything changed.
+    bool flushEdits();
+
   private:
     // Helpers.
+    static void initFrames(const vector<ShapeData *> &frames, const vector<vector<PathVertex> > &paths);
     void readVertices(string filename, vector<PathVertex> *vertices);
+    // Plans each cubic alone when no plans are given. Ears are whatever ears_ already holds.
+    void build(const vector<PathVertex> &vertices, const vector<CubicPlan> *plans,
+      vector<ShapeVertex> *shape_vertices, vector<glm::vec2> *solids, vector<glm::vec2> *lod);
     void prepVertices(const vector<PathVertex> &vertices, vector<glm::vec2> *solids, vector<glm::vec2> *quadrics, vector<glm::vec2> *cubics);
     void makeBezierCoords(const vector<glm::vec2> &quadrics, vector<glm::vec2> *bezier_coords);
+    void makeCubicTriangles(const vector<glm::vec2> &cubics, vector<glm::vec2> *triangles, vector<glm::vec3> *cubic_coords);
+    void makeCubicTriangles(const vector<glm::vec2> &cubics, const vector<CubicPlan> &plans,
+      vector<glm::vec2> *triangles, vector<glm::vec3> *cubic_coords);
+    void makeLodVertices(const vector<PathVertex> &vertices, vector<glm::vec2> *lod);
+    void flattenCurve(const vector<PathVertex> &vertices, size_t index, glm::vec2 *points);
+    void addFan(const vector<glm::vec2> &fan, vector<ShapeVertex> *shape_vertices);
     void findCorners(const vector<PathVertex> &vertices);
+    // Dynamic helpers.
+    void rebuild();
+    void mapPath();
+    void updateCurve(size_t index);
+    void updateFan(const vector<glm::vec2> &fan, size_t first, size_t point);
+    void markDirty(size_t first, size_t count);
+    void updateEars();
     // Member data.
-    bool has_solids_, has_quadrics_, has_cubics_;
-    size_t solids_size_, quadrics_size_, cubics_size_;
+    bool allocated_, dynamic_, ears_stale_;
+    size_t curves_size_, lod_size_, quadrics_first_, cubics_first_, per_frame_cubics_size_;
     glm::vec2 min_corner_, max_corner_;
-    GLuint solid_buffer_object_, quadric_buffer_object_, bezier_coords_buffer_object_, cubic_buffer_object_;
+    ShapeBufferPool *pool_;
+    ShapeBufferRange range_;
+    vector<int> ears_;
+    // Dynamic shapes keep the path, what we built from it, and for each path vertex its index among the
+    // solids or flattened points and the curve it starts. -1 where that doesn't apply.
+    vector<PathVertex> path_;
+    vector<glm::vec2> solids_, lod_;
+    vector<ShapeVertex> vertices_;
+    vector<int> solid_indices_, curve_indices_, lod_indices_;
+    // Changed vertex ranges, first and count, waiting for flushEdits.
+    vector<std::pair<size_t, size_t> > dirty_;
 };
 
 struct NamedFile {
@@ -71,26 +141,41 @@ class Shape : public Entity {
     void init(const vector<PathVertex> &vertices);
     void init(string filename);
     void init(const vector<NamedFile> &frames, Animator *animator);
-    void extent(glm::vec2 *min, glm::vec2 *max) { *min = min_; *max = max_; }
+    // Draws data owned elsewhere, which must outlive the shape.
+    void init(ShapeData *data);
+    // Editable through data(), see ShapeData.
+    void initDynamic(const vector<PathVertex> &vertices);
+    ShapeData *data() { return data_; }
+    void extent(glm::vec2 *min, glm::vec2 *max);
     void draw() { drawHelper(false); }
     void drawOccluder() { drawHelper(true); }
+    uint64_t drawKey(bool asOccluder);
 
   private:
     // Helper methods.
     void initHelper(Fill *fill, glm::vec2 min, glm::vec2 max);
-    void createVAOs();
+    // Whether the shape is small enough on screen to draw its flattened polygon.
+    bool useLod();
+    // Whether every frame we draw has ear clipped solids, laid out the same.
+    bool findOnePass();
+    void flushEdits();
     void drawHelper(bool asOccluder);
-    void bindKeyframeBuffers();
+    const vector<GLuint> *loadKeyframesIfNeeded();
+    // VAO for the animator's current keyframe triple.
+    GLuint keyframeArrayObject();
     // Member data.
-    bool animated_, from_file_;
+    bool animated_, from_file_, one_pass_;
     ShapeData *data_;
     glm::vec2 min_, max_;
     // Animation stuff.
-    map<string, ShapeData *> frames_;
+    // In the same order as the animator's frame table.
+    vector<ShapeData *> frames_;
     Animator *animator_;
     float lerp_ts_[2];
-    // OpenGL stuff
-    GLuint solid_array_object_, quadric_array_object_, cubic_array_object_;
+    // OpenGL stuff. Static shapes draw with their data's shared VAO. Animated ones share a VAO per keyframe
+    // triple, indexed by the three frame indices, with every shape using the same frames.
+    string keyframes_name_;
+    const vector<GLuint> *keyframe_array_objects_;
 };
 
 #endif  // SRC_PATH_SHAPE_H_
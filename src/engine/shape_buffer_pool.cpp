@@ -0,0 +1,94 @@
+#include "engine/shape_buffer_pool.h"
+
+#include <cassert>
+#include <cstddef>
+
+#include "engine/engine.h"
+
+// Vertices per block. At 24 bytes a vertex this is about a megabyte and a half, which holds every
+// path the demo loads a couple times over.
+static const size_t kBlockVertices = 1 << 16;
+
+ShapeBufferRange ShapeBufferPool::allocate(const vector<ShapeVertex> &vertices) {
+  ShapeBufferRange range;
+  range.count = vertices.size();
+  // First fit.
+  range.block = blocks_.size();
+  map<size_t, size_t>::iterator free_it;
+  for (size_t i = 0; i < blocks_.size() && range.block == blocks_.size(); ++i) {
+    map<size_t, size_t> &free_ranges = blocks_[i].free_ranges;
+    for (free_it = free_ranges.begin(); free_it != free_ranges.end(); ++free_it) {
+      if (free_it->second >= range.count) {
+        range.block = i;
+        break;
+      }
+    }
+  }
+  if (range.block == blocks_.size()) {
+    addBlock(glm::max(kBlockVertices, range.count));
+    free_it = blocks_.back().free_ranges.begin();
+  }
+  // Carve our range off the front of the free one.
+  Block &block = blocks_[range.block];
+  range.first = free_it->first;
+  size_t remaining = free_it->second - range.count;
+  block.free_ranges.erase(free_it);
+  if (remaining > 0) block.free_ranges[range.first + range.count] = remaining;
+
+  if (range.count > 0) {
+    glBindBuffer(GL_ARRAY_BUFFER, block.buffer_object);
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(ShapeVertex) * range.first, sizeof(ShapeVertex) * range.count, &vertices[0]);
+  }
+  return range;
+}
+
+void ShapeBufferPool::release(const ShapeBufferRange &range) {
+  if (range.count == 0) return;
+  map<size_t, size_t> &free_ranges = blocks_[range.block].free_ranges;
+  size_t first = range.first, count = range.count;
+  // Merge with the free ranges on either side.
+  map<size_t, size_t>::iterator next = free_ranges.lower_bound(first);
+  if (next != free_ranges.end() && next->first == first + count) {
+    count += next->second;
+    free_ranges.erase(next++);
+  }
+  if (next != free_ranges.begin()) {
+    map<size_t, size_t>::iterator previous = next;
+    --previous;
+    if (previous->first + previous->second == first) {
+      first = previous->first;
+      count += previous->second;
+      free_ranges.erase(previous);
+    }
+  }
+  free_ranges[first] = count;
+}
+
+void ShapeBufferPool::update(const ShapeBufferRange &range, size_t offset, size_t count, const ShapeVertex *vertices) {
+  assert(offset + count <= range.count);
+  if (count == 0) return;
+  glBindBuffer(GL_ARRAY_BUFFER, blocks_[range.block].buffer_object);
+  glBufferSubData(GL_ARRAY_BUFFER, sizeof(ShapeVertex) * (range.first + offset), sizeof(ShapeVertex) * count, vertices);
+}
+
+void ShapeBufferPool::addBlock(size_t size) {
+  Block block;
+  glGenBuffers(1, &block.buffer_object);
+  glBindBuffer(GL_ARRAY_BUFFER, block.buffer_object);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(ShapeVertex) * size, NULL, usage_);
+
+  glGenVertexArrays(1, &block.array_object);
+  glBindVertexArray(block.array_object);
+  GLuint handle = theEngine().attributeHandle("position");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, sizeof(ShapeVertex), (void *)offsetof(ShapeVertex, position));
+  handle = theEngine().attributeHandle("bezier_coord");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribPointer(handle, 3, GL_FLOAT, GL_FALSE, sizeof(ShapeVertex), (void *)offsetof(ShapeVertex, bezier_coord));
+  handle = theEngine().attributeHandle("segment_type");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribIPointer(handle, 1, GL_INT, sizeof(ShapeVertex), (void *)offsetof(ShapeVertex, segment_type));
+
+  block.free_ranges[0] = size;
+  blocks_.push_back(block);
+}
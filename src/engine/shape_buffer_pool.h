@@ -0,0 +1,52 @@
+#ifndef SRC_SHAPE_BUFFER_POOL_H_
+#define SRC_SHAPE_BUFFER_POOL_H_
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <map>
+#include <vector>
+
+using std::map;
+using std::vector;
+
+// What we actually send to GL. Solid, quadric and cubic triangles share one interleaved layout, so the
+// whole stencil phase of a shape is a single draw. The segment type is one of the PathVertexTypes in
+// shape.h and tells the path shader which implicit curve to test the bezier coord against.
+struct ShapeVertex {
+  glm::vec2 position;
+  glm::vec3 bezier_coord;
+  GLint segment_type;
+};
+
+// Where a shape's vertices ended up in the pool.
+struct ShapeBufferRange {
+  size_t block;
+  size_t first, count;
+};
+
+// Sub-allocates path geometry from a few large buffers. Each block has a single VAO set up for the
+// ShapeVertex format, so shapes in the same block only differ by first and count when drawn.
+class ShapeBufferPool {
+  public:
+    // Usage is the GL buffer usage hint for every block.
+    explicit ShapeBufferPool(GLenum usage) : usage_(usage) {}
+    ~ShapeBufferPool() {}
+    // Copies vertices into the first block with room, adding a block if none has any.
+    ShapeBufferRange allocate(const vector<ShapeVertex> &vertices);
+    void release(const ShapeBufferRange &range);
+    // Overwrites count vertices of a range starting at offset, leaving the rest alone.
+    void update(const ShapeBufferRange &range, size_t offset, size_t count, const ShapeVertex *vertices);
+    GLuint bufferObject(const ShapeBufferRange &range) { return blocks_[range.block].buffer_object; }
+    GLuint arrayObject(const ShapeBufferRange &range) { return blocks_[range.block].array_object; }
+  private:
+    struct Block {
+      GLuint buffer_object, array_object;
+      // Free vertex ranges, count keyed by first vertex. Sorted so neighbours are easy to merge.
+      map<size_t, size_t> free_ranges;
+    };
+    void addBlock(size_t size);
+    GLenum usage_;
+    vector<Block> blocks_;
+};
+
+#endif  // SRC_SHAPE_BUFFER_POOL_H_
@@ -25,7 +25,10 @@ void ShapeGroup::init(string filename) {
   bool has_animations = json_animations.type != json_none;
   bool has_colors = json_colors.type != json_none;
   int num_fills = json_fills.getLength();
-  string start_frame;
+  vector<string> frame_names;
+  for (int frame_index = 0; frame_index < json_frames.getLength(); frame_index++) {
+    frame_names.push_back(json_frames.getNameAt(frame_index));
+  }
   for (int fill_index = 0; fill_index < num_fills; fill_index++) {
     ShapeAndFill *shape_and_fill = new ShapeAndFill();
     TexturedFill &fill = shape_and_fill->fill;
@@ -42,8 +45,7 @@ void ShapeGroup::init(string filename) {
       vector<NamedFile> frames;
       for (int frame_index = 0; frame_index < json_frames.getLength(); frame_index++) {
         NamedFile frame;
-        frame.name = json_frames.getNameAt(frame_index);
-        if (frame_index == 0) start_frame = frame.name;
+        frame.name = frame_names[frame_index];
         const json_value &json_files = json_frames.getValueAt(frame_index);
         assert(json_files.getLength() == num_fills);
         frame.file = "content/paths/" + json_files[fill_name].getString();
@@ -68,12 +70,8 @@ void ShapeGroup::init(string filename) {
     shapes_[fill_name] = shape_and_fill;
     priority++;
   }
-  animator_.setParent(this);
-  if (has_animations) {
-    animator_.init(json_animations, start_frame);
-  } else {
-    animator_.init(start_frame);
-  }
+  // Without animations the animator just rests on the first frame.
+  if (has_animations) animator_.init(json_animations, frame_names);
   json_value_free(&group_json);
 }
 
@@ -1,8 +1,13 @@
 #include "engine/text.h"
 
-#include FT_GLYPH_H
+#include <cstddef>
+#include <limits>
+#include <utility>
+
+#include FT_OUTLINE_H
 
 #include "engine/engine.h"
+#include "engine/glyph_cache.h"
 #include "util/transform2D.h"
 #include "util/error.h"
 
@@ -18,10 +23,113 @@ static FT_Face loadIfNeeded(string fontfile) {
   return loaded_font_faces[fontfile];
 }
 
+// A glyph's outline as a path, in ems, and how far it moves the pen in font units. Empty glyphs have no data.
+struct GlyphOutline {
+  ShapeData *data;
+  long advance;
+};
+static map<std::pair<FT_Face, FT_UInt>, GlyphOutline> loaded_glyph_outlines;
+
+// Collects a decomposed outline as path vertices. Freetype closes contours implicitly, we close them by
+// returning to their start. Contours then follow each other in one path. Each one is reached from the
+// first contour's start and left back to it, so every seam is crossed there and back and cancels out
+// under the stencil's even odd fill.
+struct OutlineBuilder {
+  vector<PathVertex> *path;
+  float scale;
+  size_t contour_start;
+  int contours;
+};
+
+static void addPathVertex(OutlineBuilder *builder, const FT_Vector *point, PathVertexType type) {
+  PathVertex vertex;
+  vertex.position = glm::vec2(point->x, point->y) * builder->scale;
+  vertex.type = type;
+  builder->path->push_back(vertex);
+}
+
+static void closeContour(OutlineBuilder *builder) {
+  if (builder->contours == 0) return;
+  PathVertex start = (*builder->path)[builder->contour_start];
+  if (builder->path->back().position != start.position) builder->path->push_back(start);
+  // Head back along the seam we came in on.
+  PathVertex first = builder->path->front();
+  if (builder->contour_start != 0 && start.position != first.position) builder->path->push_back(first);
+}
+
+static int outlineMoveTo(const FT_Vector *to, void *user) {
+  OutlineBuilder *builder = static_cast<OutlineBuilder *>(user);
+  closeContour(builder);
+  builder->contour_start = builder->path->size();
+  ++builder->contours;
+  addPathVertex(builder, to, ON_PATH);
+  return 0;
+}
+
+static int outlineLineTo(const FT_Vector *to, void *user) {
+  addPathVertex(static_cast<OutlineBuilder *>(user), to, ON_PATH);
+  return 0;
+}
+
+static int outlineConicTo(const FT_Vector *control, const FT_Vector *to, void *user) {
+  OutlineBuilder *builder = static_cast<OutlineBuilder *>(user);
+  addPathVertex(builder, control, QUADRIC);
+  addPathVertex(builder, to, ON_PATH);
+  return 0;
+}
+
+static int outlineCubicTo(const FT_Vector *control1, const FT_Vector *control2, const FT_Vector *to, void *user) {
+  OutlineBuilder *builder = static_cast<OutlineBuilder *>(user);
+  addPathVertex(builder, control1, CUBIC);
+  addPathVertex(builder, control2, CUBIC);
+  addPathVertex(builder, to, ON_PATH);
+  return 0;
+}
+
+static const GlyphOutline &loadOutlineIfNeeded(FT_Face face, FT_UInt index) {
+  std::pair<FT_Face, FT_UInt> key(face, index);
+  if (loaded_glyph_outlines.count(key) == 0) {
+    GlyphOutline &outline = loaded_glyph_outlines[key];
+    outline.data = NULL;
+    outline.advance = 0;
+    if (FT_Load_Glyph(face, index, FT_LOAD_NO_SCALE) || face->glyph->format != FT_GLYPH_FORMAT_OUTLINE) {
+      return outline;
+    }
+    outline.advance = face->glyph->advance.x;
+    vector<PathVertex> path;
+    OutlineBuilder builder = {&path, 1.0f / face->units_per_EM, 0, 0};
+    FT_Outline_Funcs funcs = {outlineMoveTo, outlineLineTo, outlineConicTo, outlineCubicTo, 0, 0};
+    FT_Outline_Decompose(&face->glyph->outline, &funcs, &builder);
+    closeContour(&builder);
+    // A path ending on a line back to its start can leave that to the path's own closing line.
+    if (path.size() > 2 && path.back().position == path.front().position &&
+        path[path.size() - 2].type == ON_PATH) {
+      path.pop_back();
+    }
+    if (path.size() >= 3) {
+      outline.data = new ShapeData();
+      outline.data->init(path);
+    }
+  }
+  return loaded_glyph_outlines[key];
+}
+
 Text::Text()
-  : line_height_(0.2f) {}
+  : line_height_(0.2f),
+    distance_field_(false),
+    outlined_(false),
+    glyph_generation_(-1),
+    array_object_(0),
+    buffer_object_(0),
+    vertex_count_(0) {}
 
-Text::~Text() {}
+Text::~Text() {
+  clearOutlines();
+  if (array_object_ != 0) {
+    glDeleteVertexArrays(1, &array_object_);
+    glDeleteBuffers(1, &buffer_object_);
+  }
+}
 
 void Text::init() {
   if (ft == NULL) {
@@ -31,27 +139,17 @@ void Text::init() {
   }
   font_face_ = loadIfNeeded(DEFAULT_FONT);
 
-  // Set up textures
-  GLuint textures[2];
-  glGenTextures(2, textures);
-  for (int i = 0; i < 2; i++) {
-    glBindTexture(GL_TEXTURE_2D, textures[i]);
-    // Clamping to edges is important to prevent artifacts when scaling
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    // Linear filtering usually looks best for text
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-  }
-  glyph_texture_ = textures[0];
-  line_texture_ = textures[1];
-
-  // Set up frame buffer
-  glGenFramebuffers(1, &line_frame_buffer_);
-  glBindFramebuffer(GL_FRAMEBUFFER, line_frame_buffer_);
-  glBindTexture(GL_TEXTURE_2D, line_texture_);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, line_texture_, 0);
+  glGenVertexArrays(1, &array_object_);
+  glGenBuffers(1, &buffer_object_);
+  glBindVertexArray(array_object_);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer_object_);
+  GLuint handle = theEngine().attributeHandle("position");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, sizeof(GlyphVertex), (void *)offsetof(GlyphVertex, position));
+  handle = theEngine().attributeHandle("tex_coord");
+  glEnableVertexAttribArray(handle);
+  glVertexAttribPointer(handle, 2, GL_FLOAT, GL_FALSE, sizeof(GlyphVertex), (void *)offsetof(GlyphVertex, tex_coord));
+  glBindVertexArray(0);
 }
 
 void Text::setFont(string font_file) {
@@ -68,6 +166,26 @@ void Text::setLineHeight(float height) {
   renderLine();
 }
 
+void Text::setDistanceField(bool distance_field) {
+  distance_field_ = distance_field;
+  renderLine();
+}
+
+void Text::setOutlined(bool outlined) {
+  outlined_ = outlined;
+  if (!outlined_) clearOutlines();
+  renderLine();
+}
+
+// Our fill and shadow settings can change after the glyphs are laid out, so pass them on every update.
+void Text::update(float delta_time) {
+  for (vector<Shape *>::iterator it = glyph_shapes_.begin(); it != glyph_shapes_.end(); ++it) {
+    (*it)->setFill(fill());
+    (*it)->setIsOccluder(isOccluder());
+    (*it)->setOccluderColor(occluderColor());
+  }
+}
+
 void Text::extent(glm::vec2 *min, glm::vec2 *max) {
   *min = render_offset_;
   *max = render_offset_ + render_size_;
@@ -82,21 +200,21 @@ void Text::drawOccluder() {
 }
 
 void Text::drawHelper(bool occluder) {
+  // Our glyph shapes draw themselves.
+  if (outlined_) return;
+  if (glyph_generation_ != theGlyphCache().generation()) renderLine();
   glEnable(GL_STENCIL_TEST);
   glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
   glStencilFunc(GL_ALWAYS, 0, 0xFF);
   glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
-  theEngine().useProgram("text_stencil");
+  theEngine().useProgram(distance_field_ ? "text_distance_stencil" : "text_stencil");
   glEnable(GL_DEPTH_TEST);
 
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, line_texture_);
-  // Calculate the modelview transform
-  glm::mat3 modelview(1.0f);
-  modelview = translate2D(modelview, render_offset_);
-  modelview = scale2D(modelview, render_size_);
-  glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(fullTransform() * modelview));
-  theEngine().drawUnitQuad();
+  // Glyph quads are already laid out in our coordinates.
+  theEngine().bindTexture(0, theGlyphCache().texture());
+  glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(fullTransform()));
+  glBindVertexArray(array_object_);
+  glDrawArrays(GL_TRIANGLES, 0, vertex_count_);
 
   // Fill in
   glDisable(GL_DEPTH_TEST);
@@ -111,106 +229,129 @@ void Text::drawHelper(bool occluder) {
   glDisable(GL_STENCIL_TEST);
 }
 
+// Glyphs come from the cache, so changing the text only rasterizes glyphs nobody has used yet. Kerning
+// adapted from http://www.freetype.org/freetype2/docs/tutorial/step2.html
 void Text::renderLine() {
-  int pixel_line_height = (int)theEngine().getPixelHeight(line_height_);
-  FT_Set_Pixel_Sizes(font_face_, pixel_line_height, pixel_line_height);
+  if (outlined_) {
+    layoutOutlines();
+    return;
+  }
+  // Distance fields are the same at every size, so we don't care how big we are on screen.
+  int pixel_line_height = distance_field_ ? GlyphCache::kDistanceFieldSize : (int)theEngine().getPixelHeight(line_height_);
+  float pixel_size = line_height_ / pixel_line_height;
 
-  // First pass load up glyphs calculate kerning
-  // Adapted from http://www.freetype.org/freetype2/docs/tutorial/step2.html
-  int x = 0, y = 0, num_glyphs  = 0;
+  // The atlas can be emptied partway through the line, taking the glyphs before with it. Then we go once more
+  // from the top, and if the line still doesn't fit we keep what came after the last emptying.
+  vector<GlyphVertex> vertices;
+  glm::ivec2 pixel_min, pixel_max;
+  bool use_kerning = FT_HAS_KERNING(font_face_) != 0;
+  for (int pass = 0; pass < 2; ++pass) {
+    int generation = theGlyphCache().generation();
+    bool emptied = false;
+    vertices.clear();
+    pixel_min = glm::ivec2(std::numeric_limits<int>::max());
+    pixel_max = -pixel_min;
+    int x = 0;
+    FT_UInt previous = 0;
+    for (const char *char_pointer = text_.c_str(); *char_pointer; char_pointer++) {
+      FT_UInt glyph_index = FT_Get_Char_Index(font_face_, *char_pointer);
+      const Glyph &glyph = theGlyphCache().glyph(font_face_, pixel_line_height, glyph_index, distance_field_);
+      if (generation != theGlyphCache().generation()) {
+        generation = theGlyphCache().generation();
+        emptied = true;
+        vertices.clear();
+        pixel_min = glm::ivec2(std::numeric_limits<int>::max());
+        pixel_max = -pixel_min;
+      }
+      // The cache sized the face for us, so kerning comes out in our pixels.
+      if (use_kerning && previous && glyph_index) {
+        FT_Vector delta;
+        FT_Get_Kerning(font_face_, previous, glyph_index, FT_KERNING_DEFAULT, &delta);
+        x += delta.x >> 6;
+      }
+      if (glyph.size.x > 0 && glyph.size.y > 0) {
+        // Freetype bitmaps start at the top left, so the top of the quad gets the first atlas row.
+        glm::ivec2 top_left(x + glyph.offset.x, glyph.offset.y);
+        glm::ivec2 bottom_right(top_left.x + glyph.size.x, top_left.y - glyph.size.y);
+        pixel_min = glm::min(pixel_min, glm::ivec2(top_left.x, bottom_right.y));
+        pixel_max = glm::max(pixel_max, glm::ivec2(bottom_right.x, top_left.y));
+        GlyphVertex corners[4] = {
+          {glm::vec2(top_left.x, bottom_right.y) * pixel_size, glm::vec2(glyph.tex_min.x, glyph.tex_max.y)},
+          {glm::vec2(bottom_right) * pixel_size, glyph.tex_max},
+          {glm::vec2(top_left) * pixel_size, glyph.tex_min},
+          {glm::vec2(bottom_right.x, top_left.y) * pixel_size, glm::vec2(glyph.tex_max.x, glyph.tex_min.y)}};
+        vertices.push_back(corners[0]);
+        vertices.push_back(corners[1]);
+        vertices.push_back(corners[2]);
+        vertices.push_back(corners[2]);
+        vertices.push_back(corners[1]);
+        vertices.push_back(corners[3]);
+      }
+      x += glyph.advance;
+      previous = glyph_index;
+    }
+    glyph_generation_ = generation;
+    if (!emptied) break;
+  }
+
+  if (vertices.empty()) pixel_min = pixel_max = glm::ivec2(0);
+  render_offset_ = glm::vec2(pixel_min) * pixel_size;
+  render_size_ = glm::vec2(pixel_max - pixel_min) * pixel_size;
+  vertex_count_ = vertices.size();
+  glBindBuffer(GL_ARRAY_BUFFER, buffer_object_);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GlyphVertex), vertices.empty() ? NULL : &vertices[0],
+    GL_DYNAMIC_DRAW);
+}
+
+void Text::clearOutlines() {
+  clearOutlinesFrom(0);
+}
+
+// Deletes our glyph shapes from index on.
+void Text::clearOutlinesFrom(size_t index) {
+  for (vector<Shape *>::iterator it = glyph_shapes_.begin() + index; it != glyph_shapes_.end(); ++it) {
+    delete *it;
+  }
+  glyph_shapes_.resize(index);
+}
+
+// Outlines are in ems, so a glyph shape is just moved to the pen and scaled by the line height. Glyph
+// shapes from the last layout are pointed at their new outlines, and only the ones left over are deleted.
+void Text::layoutOutlines() {
+  size_t used = 0;
+  float em = static_cast<float>(font_face_->units_per_EM);
+  glm::vec2 min(std::numeric_limits<float>::max()), max(-std::numeric_limits<float>::max());
+  long x = 0;
   bool use_kerning = FT_HAS_KERNING(font_face_) != 0;
   FT_UInt previous = 0;
-  FT_Glyph *glyphs = new FT_Glyph[text_.length()];
   for (const char *char_pointer = text_.c_str(); *char_pointer; char_pointer++) {
-    // Convert character code to glyph index
     FT_UInt glyph_index = FT_Get_Char_Index(font_face_, *char_pointer);
-    // Retrieve kerning distance and move pen position
-    if (use_kerning && previous && glyph_index)
-    {
+    if (use_kerning && previous && glyph_index) {
       FT_Vector delta;
-      FT_Get_Kerning(font_face_, previous, glyph_index,
-                      FT_KERNING_DEFAULT, &delta);
-      x += delta.x >> 6;
-      y += delta.y >> 6;
-    }
-    // Load glyph image into the slot without rendering
-    if (FT_Load_Glyph(font_face_, glyph_index, FT_LOAD_DEFAULT)) {
-      continue;
+      FT_Get_Kerning(font_face_, previous, glyph_index, FT_KERNING_UNSCALED, &delta);
+      x += delta.x;
     }
-    // Extract glyph image and store it in our table
-    if (FT_Get_Glyph(font_face_->glyph, &glyphs[num_glyphs])) {
-      continue;
+    const GlyphOutline &outline = loadOutlineIfNeeded(font_face_, glyph_index);
+    if (outline.data != NULL) {
+      glm::vec2 pen(line_height_ * x / em, 0.0f);
+      if (used == glyph_shapes_.size()) {
+        glyph_shapes_.push_back(new Shape());
+        glyph_shapes_.back()->setParent(this);
+      }
+      Shape *shape = glyph_shapes_[used++];
+      shape->init(outline.data);
+      shape->setRelativeTransform(scale2D(translate2D(glm::mat3(1.0f), pen), glm::vec2(line_height_)));
+      glm::vec2 glyph_min, glyph_max;
+      outline.data->extent(&glyph_min, &glyph_max);
+      min = glm::min(min, pen + glyph_min * line_height_);
+      max = glm::max(max, pen + glyph_max * line_height_);
     }
-    // Transform glyph offset in 64ths of pixel
-    FT_Vector offset;
-    offset.x = x * 64;
-    offset.y = y * 64;
-    FT_Glyph_Transform(glyphs[num_glyphs], 0, &offset);
-
-    x += font_face_->glyph->advance.x >> 6;
-    y += font_face_->glyph->advance.y >> 6;
+    x += outline.advance;
     previous = glyph_index;
-    num_glyphs++;
-  }
-
-  // Second pass, calculate bounding box of rendering area
-  FT_BBox  bbox, glyph_bbox;
-  bbox.xMin = bbox.yMin = std::numeric_limits<int>::max();
-  bbox.xMax = bbox.yMax = -std::numeric_limits<int>::max();
-  // For each glyph image, compute its bounding box
-  for ( int i = 0; i < num_glyphs; i++ )
-  {
-    FT_Glyph_Get_CBox( glyphs[i], ft_glyph_bbox_pixels,
-                       &glyph_bbox );
-    if ( glyph_bbox.xMin < bbox.xMin )
-      bbox.xMin = glyph_bbox.xMin;
-    if ( glyph_bbox.yMin < bbox.yMin )
-      bbox.yMin = glyph_bbox.yMin;
-    if ( glyph_bbox.xMax > bbox.xMax )
-      bbox.xMax = glyph_bbox.xMax;
-    if ( glyph_bbox.yMax > bbox.yMax )
-      bbox.yMax = glyph_bbox.yMax;
-  }
-  int line_texture_width = bbox.xMax - bbox.xMin;
-  int line_texture_height = bbox.yMax - bbox.yMin;
-  render_size_.x = line_height_ * line_texture_width / pixel_line_height;
-  render_size_.y = line_height_ * line_texture_height / pixel_line_height;
-  render_offset_.x = line_height_ * bbox.xMin / pixel_line_height;
-  render_offset_.y = line_height_ * bbox.yMin / pixel_line_height;
-
-  // Set up GL to render to line texture
-  glBindTexture(GL_TEXTURE_2D, line_texture_);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, line_texture_width, line_texture_height, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);  
-  glBindFramebuffer(GL_FRAMEBUFFER, line_frame_buffer_);
-  glViewport(0, 0, line_texture_width, line_texture_height);
-  glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-  glClear(GL_COLOR_BUFFER_BIT | GL_STENCIL_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-  theEngine().useProgram("text_to_texture");
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, glyph_texture_);
-
-  // Final pass render to texture
-  for ( int i = 0; i < num_glyphs; i++ ) {
-    // Render the bitmap
-    if (FT_Glyph_To_Bitmap(&glyphs[i], FT_RENDER_MODE_NORMAL, NULL, 0)) {
-      continue;
-    }
-    FT_BitmapGlyph bitglyph = (FT_BitmapGlyph)glyphs[i];
-
-    // Upload the bitmap, which contains an 8-bit grayscale image, as an 1 channel texture
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, bitglyph->bitmap.width, bitglyph->bitmap.rows, 0, GL_RED, GL_UNSIGNED_BYTE, bitglyph->bitmap.buffer);
-    glm::mat3 modelview(1.0f);
-    // Translate from the opengl screen coords to pixel coord system
-    modelview = translate2D(modelview, glm::vec2(-1.0f, -1.0f));
-    modelview = scale2D(modelview, glm::vec2(2.0f / line_texture_width, 2.0f / line_texture_height));
-    modelview = translate2D(modelview, glm::vec2(bitglyph->left - bbox.xMin, bitglyph->top - bbox.yMin));
-    // Freetype coordinates start at topleft instead of bottom left, so we need to flip y
-    modelview = scale2D(modelview, glm::vec2(bitglyph->bitmap.width, -1.0f * bitglyph->bitmap.rows));
-    // Draw the character on the screen
-    glUniformMatrix3fv(theEngine().uniformHandle("modelview"), 1, GL_FALSE, glm::value_ptr(modelview));
-    theEngine().drawUnitQuad();
-
-    FT_Done_Glyph(glyphs[i]);
   }
-  delete[] glyphs;
+  clearOutlinesFrom(used);
+  if (glyph_shapes_.empty()) min = max = glm::vec2(0.0f);
+  render_offset_ = min;
+  render_size_ = max - min;
+  update(0.0f);
 }
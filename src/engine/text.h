@@ -4,13 +4,21 @@
 #include <GL/glew.h>
 #include <glm/gtc/type_ptr.hpp>
 #include <string>
+#include <vector>
 
 #include "engine/entity.h"
 #include "engine/fill.h"
+#include "engine/shape.h"
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
 using std::string;
+using std::vector;
+
+struct GlyphVertex {
+  glm::vec2 position;
+  glm::vec2 tex_coord;
+};
 
 class Text : public Entity {
   public:
@@ -20,21 +28,35 @@ class Text : public Entity {
     void setFont(string font_file);
     void setText(string text);
     void setLineHeight(float height);
+    // Draws from distance field glyphs, which stay sharp however the text is scaled. Off by default.
+    void setDistanceField(bool distance_field);
+    // Draws each glyph as a path shape from the font's outlines, crisp under any transform. The shapes are
+    // our children and sort with every other shape. Textured fills are placed per glyph.
+    void setOutlined(bool outlined);
+    void update(float delta_time);
     void extent(glm::vec2 *min, glm::vec2 *max);
     void draw();
     void drawOccluder();
 
   private:
+    // Lays the line out as glyph quads over the shared glyph atlas.
     void renderLine();
     void drawHelper(bool occluder);
+    void layoutOutlines();
+    void clearOutlines();
+    void clearOutlinesFrom(size_t index);
     // Member data.
     FT_Face font_face_;
     string text_;
     float line_height_;
+    bool distance_field_, outlined_;
+    vector<Shape *> glyph_shapes_;
     glm::vec2 render_offset_, render_size_;
+    // Atlas generation our quads were built for. Rebuilt if the atlas has been emptied since.
+    int glyph_generation_;
     // GL stuff
-    GLuint line_frame_buffer_;
-    GLuint glyph_texture_, line_texture_;
+    GLuint array_object_, buffer_object_;
+    int vertex_count_;
 };
 
 #endif  // TEXT_H_
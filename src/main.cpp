@@ -4,6 +4,7 @@
 #include <GLFW/glfw3.h>
 
 #include "game.h"
+#include "engine/engine.h"
 #include "util/settings.h"
 #include "util/error.h"
 
@@ -108,6 +109,7 @@ int main(int argc, char *argv[]) {
       time_drawing = 0.0f;
       printf("Update time per frame: %f.\n", time_updating / print_frequency);
       time_updating = 0.0f;
+      theEngine().printPassTimes();
     }
     glfwSwapBuffers(window);
     glfwPollEvents();
@@ -0,0 +1,129 @@
+// Times the two ways of drawing particle billboards, geometry shader expansion and instanced quads, and
+// the two simulation backends, transform feedback and the CPU, at a range of particle counts. Run from
+// the repo root so shaders and textures are found.
+#include <stdlib.h>
+#include <stdio.h>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "engine/engine.h"
+#include "engine/particle_system.h"
+#include "util/error.h"
+#include "util/random.h"
+
+static const int kWidth = 800;
+static const int kHeight = 600;
+static const float kDeltaTime = 1.0f / 60.0f;
+// Enough updates for every emitter to reach its steady population.
+static const int kWarmupFrames = 120;
+static const int kTimedFrames = 60;
+static const int kParticleCounts[] = {10000, 100000, 1000000};
+
+void cleanupAndExit(int exit_code) {
+  glfwTerminate();
+  exit(exit_code);
+}
+
+// Average milliseconds per draw, from the GPU's timer and from the wall clock finishing each draw. Software
+// GL rasterizes late, so only the wall clock sees it there.
+static void timeDraws(ParticleSystem *particles, double *gpu_time, double *wall_time) {
+  GLuint query;
+  glGenQueries(1, &query);
+  GLuint64 total = 0;
+  double wall_total = 0.0;
+  for (int i = 0; i < kTimedFrames; ++i) {
+    glClear(GL_COLOR_BUFFER_BIT);
+    glFinish();
+    double start = glfwGetTime();
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    particles->draw();
+    glEndQuery(GL_TIME_ELAPSED);
+    glFinish();
+    wall_total += glfwGetTime() - start;
+    GLuint64 nanoseconds;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &nanoseconds);
+    total += nanoseconds;
+  }
+  glDeleteQueries(1, &query);
+  *gpu_time = total / 1000000.0 / kTimedFrames;
+  *wall_time = wall_total * 1000.0 / kTimedFrames;
+}
+
+// Average wall clock milliseconds per update, finishing each one so GPU and CPU work both count.
+static double timeUpdates(ParticleSystem *particles) {
+  glFinish();
+  double start = glfwGetTime();
+  for (int i = 0; i < kTimedFrames; ++i) {
+    particles->update(kDeltaTime);
+    glFinish();
+  }
+  return (glfwGetTime() - start) * 1000.0 / kTimedFrames;
+}
+
+static void setUp(ParticleSystem *particles, int num_particles, ParticleBackend backend) {
+  int num_emitters = num_particles / ParticleSystem::kParticlesPerEmitter;
+  particles->init(num_emitters, 0, backend);
+  // Spread over the same depths the ideas fly in, so billboards are a typical size on screen. Seeded
+  // alike, so both backends get the same emitters.
+  srand(num_particles);
+  for (int i = 0; i < num_emitters; ++i) {
+    particles->setEmitterPosition(i, glm::vec3(randomFloat(-1.0f, 1.0f), randomFloat(-1.0f, 1.0f), randomFloat(-4.0f, -2.2f)));
+    particles->setEmitterColor(i, glm::vec4(randomFloat(0.0f, 1.0f), randomFloat(0.0f, 1.0f), randomFloat(0.0f, 1.0f), 0.4f));
+    particles->setEmitterVisible(i, true);
+  }
+  // Count every update, so both draw paths draw the same particles.
+  particles->setInstancedBillboards(true);
+  for (int i = 0; i < kWarmupFrames; ++i) particles->update(kDeltaTime);
+}
+
+static void benchmark(int num_particles) {
+  ParticleSystem particles;
+  setUp(&particles, num_particles, GPU_PARTICLES);
+  double geometry_gpu, geometry_wall, instanced_gpu, instanced_wall;
+  particles.setInstancedBillboards(false);
+  timeDraws(&particles, &geometry_gpu, &geometry_wall);
+  particles.setInstancedBillboards(true);
+  timeDraws(&particles, &instanced_gpu, &instanced_wall);
+  double feedback_time = timeUpdates(&particles);
+  GLuint feedback_live = particles.liveCount();
+  printf("%9d capacity, %9u live: geometry shader %8.3f ms gpu %8.3f ms wall, instanced %8.3f ms gpu %8.3f ms wall\n",
+    num_particles, feedback_live, geometry_gpu, geometry_wall, instanced_gpu, instanced_wall);
+
+  ParticleSystem cpu_particles;
+  setUp(&cpu_particles, num_particles, CPU_PARTICLES);
+  double cpu_time = timeUpdates(&cpu_particles);
+  GLuint cpu_live = cpu_particles.liveCount();
+  printf("%30s update: feedback %8.3f ms, %10.0f particles/ms; cpu %8.3f ms, %10.0f particles/ms\n", "",
+    feedback_time, feedback_live / feedback_time, cpu_time, cpu_live / cpu_time);
+}
+
+int main() {
+  if (!glfwInit()) {
+    fprintf(stderr, "Failed to initialize GLFW\n");
+    exit(1);
+  }
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+  GLFWwindow *window = glfwCreateWindow(kWidth, kHeight, "Particle benchmark", NULL, NULL);
+  if (window == NULL) error("Failed to open GLFW window.\n");
+  glfwMakeContextCurrent(window);
+  glewExperimental = GL_TRUE;
+  GLenum err = glewInit();
+  if (GLEW_OK != err) error("GLEW error: %s\n", glewGetErrorString(err));
+  if (!GLEW_VERSION_3_3) error("OpenGL 3.3 is not supported.\n");
+  glGetError();
+
+  theEngine().init(kWidth, kHeight);
+  glViewport(0, 0, kWidth, kHeight);
+  glEnable(GL_BLEND);
+  glDisable(GL_DEPTH_TEST);
+  for (size_t i = 0; i < sizeof(kParticleCounts) / sizeof(kParticleCounts[0]); ++i) {
+    benchmark(kParticleCounts[i]);
+  }
+  cleanupAndExit(0);
+  return 0;
+}
@@ -0,0 +1,90 @@
+#include "util/thread_pool.h"
+
+#include <unistd.h>
+#include <algorithm>
+
+#include "util/error.h"
+
+// Several ranges per thread, so a slow one doesn't hold the rest up.
+static const int kChunksPerThread = 4;
+
+ThreadPool::ThreadPool(int num_threads)
+  : generation_(0),
+    quitting_(false),
+    task_(NULL),
+    context_(NULL),
+    count_(0),
+    chunk_(1),
+    next_(0),
+    unfinished_(0) {
+  if (num_threads <= 0) num_threads = std::max(1L, sysconf(_SC_NPROCESSORS_ONLN) - 1);
+  pthread_mutex_init(&mutex_, NULL);
+  pthread_cond_init(&job_ready_, NULL);
+  pthread_cond_init(&job_done_, NULL);
+  workers_.resize(num_threads);
+  for (vector<pthread_t>::iterator it = workers_.begin(); it != workers_.end(); ++it) {
+    if (pthread_create(&*it, NULL, workerMain, this) != 0) error("Could not start a worker thread.\n");
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  pthread_mutex_lock(&mutex_);
+  quitting_ = true;
+  pthread_cond_broadcast(&job_ready_);
+  pthread_mutex_unlock(&mutex_);
+  for (vector<pthread_t>::iterator it = workers_.begin(); it != workers_.end(); ++it) {
+    pthread_join(*it, NULL);
+  }
+  pthread_cond_destroy(&job_done_);
+  pthread_cond_destroy(&job_ready_);
+  pthread_mutex_destroy(&mutex_);
+}
+
+void ThreadPool::run(Task task, void *context, int count) {
+  if (count <= 0) return;
+  pthread_mutex_lock(&mutex_);
+  task_ = task;
+  context_ = context;
+  count_ = count;
+  chunk_ = std::max(1, (count + size() * kChunksPerThread - 1) / (size() * kChunksPerThread));
+  next_ = 0;
+  unfinished_ = (count + chunk_ - 1) / chunk_;
+  ++generation_;
+  pthread_cond_broadcast(&job_ready_);
+  pthread_mutex_unlock(&mutex_);
+  work();
+  pthread_mutex_lock(&mutex_);
+  while (unfinished_ > 0) pthread_cond_wait(&job_done_, &mutex_);
+  pthread_mutex_unlock(&mutex_);
+}
+
+void *ThreadPool::workerMain(void *pool) {
+  ThreadPool *self = static_cast<ThreadPool *>(pool);
+  unsigned int seen = 0;
+  pthread_mutex_lock(&self->mutex_);
+  while (true) {
+    while (!self->quitting_ && self->generation_ == seen) pthread_cond_wait(&self->job_ready_, &self->mutex_);
+    if (self->quitting_) break;
+    seen = self->generation_;
+    pthread_mutex_unlock(&self->mutex_);
+    self->work();
+    pthread_mutex_lock(&self->mutex_);
+  }
+  pthread_mutex_unlock(&self->mutex_);
+  return NULL;
+}
+
+void ThreadPool::work() {
+  pthread_mutex_lock(&mutex_);
+  while (next_ < count_) {
+    int begin = next_, end = std::min(count_, next_ + chunk_);
+    next_ = end;
+    Task task = task_;
+    void *context = context_;
+    pthread_mutex_unlock(&mutex_);
+    task(context, begin, end);
+    pthread_mutex_lock(&mutex_);
+    if (--unfinished_ == 0) pthread_cond_broadcast(&job_done_);
+  }
+  pthread_mutex_unlock(&mutex_);
+}
@@ -0,0 +1,37 @@
+#ifndef SRC_THREAD_POOL_H_
+#define SRC_THREAD_POOL_H_
+
+#include <pthread.h>
+#include <vector>
+
+using std::vector;
+
+// Splits a loop over [0, count) into ranges and runs them on a fixed set of worker threads. The calling
+// thread takes ranges too, and run returns once every range is done.
+class ThreadPool {
+  public:
+    typedef void (*Task)(void *context, int begin, int end);
+    // Zero threads means one per processor, less the caller's.
+    explicit ThreadPool(int num_threads = 0);
+    ~ThreadPool();
+    // Workers plus the caller.
+    int size() { return workers_.size() + 1; }
+    void run(Task task, void *context, int count);
+
+  private:
+    static void *workerMain(void *pool);
+    // Takes ranges of the current job until there are none left.
+    void work();
+    // Member data.
+    vector<pthread_t> workers_;
+    pthread_mutex_t mutex_;
+    pthread_cond_t job_ready_, job_done_;
+    // Bumped for each job, so workers wake once per job.
+    unsigned int generation_;
+    bool quitting_;
+    Task task_;
+    void *context_;
+    int count_, chunk_, next_, unfinished_;
+};
+
+#endif  // SRC_THREAD_POOL_H_
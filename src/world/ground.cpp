@@ -32,11 +32,21 @@ void Ground::initShape() {
   fill_.init("content/textures/seamlesstexture26.dds");
   fill_.setColorAddition(glm::vec4(glm::vec3(-0.05f), 1.0f));
   fill_.setColorMultiplier(glm::vec4(glm::vec3(0.3f), 1.0f));
-  shape_.init(path);
+  shape_.initDynamic(path);
   shape_.setParent(this);
   shape_.setFill(&fill_);
 }
 
+void Ground::movePoint(size_t index, glm::vec2 point) {
+  points_[index] = point;
+  // The path starts with a vertex at the origin, so ours are one further along.
+  shape_.data()->moveVertex(index + 1, point);
+  if (index == points_.size() - 1) {
+    // The closing vertex sits under the last point.
+    shape_.data()->moveVertex(points_.size() + 1, glm::vec2(point.x, 0.0f));
+  }
+}
+
 float Ground::width() {
   return points_.back().x;
 }
@@ -45,9 +55,17 @@ float Ground::heightAt(float x) {
   // TODO: this could be way more efficient if we ever need it
   if (x < 0.0f || x > width()) return 0.0f;
   size_t index;
-  for (index = 0; index < points_.size() - 1; index++) {
+  // Stop a segment short, so x right at the end still lands on the last segment.
+  for (index = 0; index < points_.size() - 2; index++) {
     if (points_[index+1].x > x) break;
   }
   glm::vec2 left = points_[index], right = points_[index+1];
   return glm::mix(left.y, right.y, (x - left.x) / (right.x - left.x));
 }
+
+void Ground::sampleHeights(int count, vector<float> *heights) {
+  heights->resize(count);
+  for (int i = 0; i < count; ++i) {
+    (*heights)[i] = heightAt(width() * i / (count - 1));
+  }
+}
@@ -17,6 +17,10 @@ class Ground : public Entity {
     void init(vector<glm::vec2> points);
     float width();
     float heightAt(float x);
+    // Heights at count points evenly spaced from zero to width(), for heightfields.
+    void sampleHeights(int count, vector<float> *heights);
+    // Moves one of the ground points. Cheap enough to call every frame.
+    void movePoint(size_t index, glm::vec2 point);
   private:
     void initShape();
     vector<glm::vec2> points_;
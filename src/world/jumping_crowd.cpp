@@ -16,8 +16,10 @@ void JumpingCrowd::init(Character *character, Ground *ground, const vector<float
   time_max_ = ground_time_max;
   initial_jump_velocity_ = jump_velocity;
   start_ = end_ = x_positions[0];
+  crowd_.init();
+  vector<CircleInstance> &circles = crowd_.circles();
   for (size_t i = 0; i < x_positions.size(); ++i) {
-    Circle circle;
+    CircleInstance circle;
     float gray = randomFloat(0.12f, 0.38f);
     circle.color = glm::vec4(gray, gray, gray, 1.0f);
     circle.center.x = x_positions[i];
@@ -25,25 +27,25 @@ void JumpingCrowd::init(Character *character, Ground *ground, const vector<float
     circle.radius = size;
     if (circle.center.x < start_) start_ = circle.center.x;
     if (circle.center.x > end_) end_ = circle.center.x;
-    crowd_.push_back(circle);
+    circles.push_back(circle);
     time_on_ground_.push_back(0.0f);
     time_till_next_jump_.push_back(jumpTime());
     jumping_.push_back(false);
     velocity_.push_back(0.0f);
     ground_height_.push_back(circle.center.y);
   }
-  // Ready drawable.
-  drawer_.init(&crowd_);
-  drawer_.setParent(theRenderer().rootNode());
-  drawer_.setDisplayPriority(2.0f);
+  crowd_.markChanged();
+  crowd_.setParent(theEngine().rootEntity());
+  crowd_.setDisplayPriority(2.0f);
 }
 
 void JumpingCrowd::update(float delta_time, GameState *state) {
   if (*state == EXPLODING || *state == PRE_EXPLODING) return;
   float character_x = character_->position().x;
-  for (size_t i = 0; i < crowd_.size(); ++i) {
+  vector<CircleInstance> &circles = crowd_.circles();
+  for (size_t i = 0; i < circles.size(); ++i) {
     if (jumping_[i]) {
-      Circle *circle = &crowd_[i];
+      CircleInstance *circle = &circles[i];
       circle->center.y += velocity_[i] * delta_time;
       velocity_[i] += kGravity * delta_time;
       if (circle->center.y < ground_height_[i]) {
@@ -54,8 +56,9 @@ void JumpingCrowd::update(float delta_time, GameState *state) {
       }
     }
   }
+  crowd_.markChanged();
   if(character_x > start_ - kActivateDistance && character_x < end_ + kActivateDistance) {
-    for (size_t i = 0; i < crowd_.size(); ++i) {
+    for (size_t i = 0; i < circles.size(); ++i) {
       if (!jumping_[i]) {
         time_on_ground_[i]+=delta_time;
         if (time_on_ground_[i] > time_till_next_jump_[i]) {
@@ -22,8 +22,8 @@ class JumpingCrowd : public GameEntity {
     Ground *ground_;
     Character *character_;
     float start_, end_, time_min_, time_max_, initial_jump_velocity_;
-    vector<Circle> crowd_;
-    CircleDrawer drawer_;
+    // All the circles go in one instanced draw.
+    CircleBatch crowd_;
     vector<float> time_on_ground_, ground_height_, time_till_next_jump_, velocity_;
     vector<bool> jumping_;
 };